@@ -3,6 +3,14 @@
 
 #include <stdint.h>
 
+/* PIT cycles per second. */
+#define PIT_HZ 1193180
+
+/* Largest count that fits the 16-bit counter. */
+#define PIT_COUNT_MAX 65535
+
 void pit_configure_channel (int channel, int mode, int frequency);
+void pit_one_shot (int channel, unsigned count);
+unsigned pit_read_count (int channel);
 
 #endif /* devices/pit.h */
@@ -18,6 +18,11 @@ void timer_sleep (int64_t ticks);
 void timer_msleep (int64_t milliseconds);
 void timer_usleep (int64_t microseconds);
 void timer_nsleep (int64_t nanoseconds);
+void timer_sleep_ns (int64_t nanoseconds);
+
+/* Tickless idle. */
+void timer_idle_enter (void);
+void timer_idle_exit (void);
 
 /* Busy waits. */
 void timer_mdelay (int64_t milliseconds);
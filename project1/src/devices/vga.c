@@ -26,6 +26,7 @@ static size_t cx, cy;
    The attribute at (x,y) is fb[y][x][1]. */
 static uint8_t (*fb)[COL_CNT][2];
 
+static void put_char (uint8_t c, enum intr_level old_level);
 static void clear_row (size_t y);
 static void cls (void);
 static void newline (void);
@@ -50,13 +51,48 @@ init (void)
    characters in the conventional ways.  */
 void
 vga_putc (int c)
+{
+  char ch = c;
+  vga_putbuf (&ch, 1);
+}
+
+/* Writes the N characters in BUFFER to the VGA text display, as
+   vga_putc() would.  Interrupts are let in only between lines,
+   and the hardware cursor is moved once at the end. */
+void
+vga_putbuf (const char *buffer, size_t n)
 {
   /* Disable interrupts to lock out interrupt handlers
      that might write to the console. */
   enum intr_level old_level = intr_disable ();
 
   init ();
-  
+  while (n-- > 0)
+    {
+      uint8_t c = *buffer++;
+
+      put_char (c, old_level);
+      if (c == '\n' && n > 0)
+        {
+          intr_set_level (old_level);
+          intr_disable ();
+        }
+    }
+
+  /* Update cursor position. */
+  move_cursor ();
+
+  intr_set_level (old_level);
+}
+
+/* Writes C at the cursor and advances it, without moving the
+   hardware cursor.  Interrupts must be off; OLD_LEVEL is the
+   level to sound the speaker at. */
+static void
+put_char (uint8_t c, enum intr_level old_level)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
   switch (c) 
     {
     case '\n':
@@ -95,11 +131,6 @@ vga_putc (int c)
         newline ();
       break;
     }
-
-  /* Update cursor position. */
-  move_cursor ();
-
-  intr_set_level (old_level);
 }
 
 /* Clears the screen and moves the cursor to the upper left. */
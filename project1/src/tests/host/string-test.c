@@ -0,0 +1,254 @@
+/* Host-side tests for lib/string.c.
+
+   Builds the kernel's string functions against the host C library
+   under other names and checks memcpy(), memmove(), memset(),
+   memcmp() and strlen() against the host's versions.  Every
+   source and destination alignment is tried with every length up
+   to a few words past the thresholds for word-at-a-time and REP
+   string instructions, plus whole pages, and memmove() with
+   overlap in both directions.
+
+   From the src directory:
+
+      cc -O -idirafter lib -o string-test tests/host/string-test.c
+      ./string-test */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Compile lib/string.c under its own names, declared by
+   lib/string.h.  The host's <string.h> is already in, so the
+   #include <string.h> in lib/string.c is a no-op. */
+#define memcpy k_memcpy
+#define memmove k_memmove
+#define memcmp k_memcmp
+#define strcmp k_strcmp
+#define memchr k_memchr
+#define strchr k_strchr
+#define strcspn k_strcspn
+#define strpbrk k_strpbrk
+#define strrchr k_strrchr
+#define strspn k_strspn
+#define strstr k_strstr
+#define strtok_r k_strtok_r
+#define memset k_memset
+#define strlen k_strlen
+#define strnlen k_strnlen
+#define strlcpy k_strlcpy
+#define strlcat k_strlcat
+#include "../../lib/string.h"
+#include "../../lib/string.c"
+#undef memcpy
+#undef memmove
+#undef memcmp
+#undef strcmp
+#undef memchr
+#undef strchr
+#undef strcspn
+#undef strpbrk
+#undef strrchr
+#undef strspn
+#undef strstr
+#undef strtok_r
+#undef memset
+#undef strlen
+#undef strnlen
+#undef strlcpy
+#undef strlcat
+
+void
+debug_panic (const char *file, int line, const char *function,
+             const char *message, ...)
+{
+  va_list args;
+
+  fprintf (stderr, "%s:%d: %s(): ", file, line, function);
+  va_start (args, message);
+  vfprintf (stderr, message, args);
+  va_end (args);
+  putc ('\n', stderr);
+  abort ();
+}
+
+/* Alignments tried for each pointer argument. */
+#define ALIGN_CNT 8
+
+/* Lengths tried: every length up to MAX_SHORT, which takes in
+   both the byte-to-word and the word-to-REP thresholds, then a
+   few page-sized ones. */
+#define MAX_SHORT (REP_MIN * 4 + WORD_MIN + ALIGN_CNT)
+static const size_t long_lengths[] = {4095, 4096, 4097, 3 * 4096 + 5};
+#define BUF_SIZE (4 * 4096)
+
+static unsigned char src_buf[BUF_SIZE];
+static unsigned char dst_buf[BUF_SIZE];
+static unsigned char ref_buf[BUF_SIZE];
+
+static int failures;
+
+static void
+fail (const char *what, size_t a, size_t b, size_t len)
+{
+  if (failures++ < 20)
+    printf ("FAIL: %s, alignments %zu and %zu, length %zu\n",
+            what, a, b, len);
+}
+
+/* Fills BUF with SIZE pseudo-random bytes, none of them zero, and
+   many with the high bit set or equal to 1, the cases a careless
+   zero-byte test gets wrong. */
+static void
+fill (unsigned char *buf, size_t size)
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    {
+      unsigned r = rand ();
+      buf[i] = (r % 4 == 0 ? 0x80 : r % 4 == 1 ? 0x01 : r % 255 + 1);
+    }
+}
+
+/* Calls F with each length to try. */
+static void
+for_each_length (void (*f) (size_t len))
+{
+  size_t len, i;
+
+  for (len = 0; len <= MAX_SHORT; len++)
+    f (len);
+  for (i = 0; i < sizeof long_lengths / sizeof *long_lengths; i++)
+    f (long_lengths[i]);
+}
+
+static void
+test_memcpy (size_t len)
+{
+  size_t s, d;
+
+  for (s = 0; s < ALIGN_CNT; s++)
+    for (d = 0; d < ALIGN_CNT; d++)
+      {
+        memset (dst_buf, 0xaa, BUF_SIZE);
+        memset (ref_buf, 0xaa, BUF_SIZE);
+        if (k_memcpy (dst_buf + d, src_buf + s, len) != dst_buf + d)
+          fail ("memcpy return value", s, d, len);
+        memcpy (ref_buf + d, src_buf + s, len);
+        if (memcmp (dst_buf, ref_buf, BUF_SIZE))
+          fail ("memcpy", s, d, len);
+      }
+}
+
+static void
+test_memmove (size_t len)
+{
+  size_t s, d;
+
+  if (len + 2 * ALIGN_CNT > BUF_SIZE)
+    return;
+  for (s = 0; s < 2 * ALIGN_CNT; s++)
+    for (d = 0; d < 2 * ALIGN_CNT; d++)
+      {
+        memcpy (dst_buf, src_buf, BUF_SIZE);
+        memcpy (ref_buf, src_buf, BUF_SIZE);
+        if (k_memmove (dst_buf + d, dst_buf + s, len) != dst_buf + d)
+          fail ("memmove return value", s, d, len);
+        memmove (ref_buf + d, ref_buf + s, len);
+        if (memcmp (dst_buf, ref_buf, BUF_SIZE))
+          fail ("memmove", s, d, len);
+      }
+}
+
+static void
+test_memset (size_t len)
+{
+  static const int values[] = {0, 0x5a, 0xff, -1, 0x1234};
+  size_t d, i;
+
+  for (d = 0; d < ALIGN_CNT; d++)
+    for (i = 0; i < sizeof values / sizeof *values; i++)
+      {
+        memset (dst_buf, 0xaa, BUF_SIZE);
+        memset (ref_buf, 0xaa, BUF_SIZE);
+        if (k_memset (dst_buf + d, values[i], len) != dst_buf + d)
+          fail ("memset return value", d, d, len);
+        memset (ref_buf + d, values[i], len);
+        if (memcmp (dst_buf, ref_buf, BUF_SIZE))
+          fail ("memset", d, d, len);
+      }
+}
+
+static int
+sign (int x)
+{
+  return (x > 0) - (x < 0);
+}
+
+static void
+test_memcmp (size_t len)
+{
+  size_t a, b, pos;
+
+  for (a = 0; a < ALIGN_CNT; a++)
+    for (b = 0; b < ALIGN_CNT; b++)
+      {
+        memcpy (dst_buf + a, src_buf, len);
+        memcpy (ref_buf + b, src_buf, len);
+        if (k_memcmp (dst_buf + a, ref_buf + b, len) != 0)
+          fail ("memcmp of equal blocks", a, b, len);
+
+        /* Make each byte in turn differ, both ways.  Long
+           lengths only try a sample of positions. */
+        for (pos = 0; pos < len; pos += len > MAX_SHORT ? 61 : 1)
+          {
+            unsigned char saved = ref_buf[b + pos];
+
+            ref_buf[b + pos] = dst_buf[a + pos] + 1;
+            if (sign (k_memcmp (dst_buf + a, ref_buf + b, len))
+                != sign (memcmp (dst_buf + a, ref_buf + b, len)))
+              fail ("memcmp with larger byte in B", a, b, len);
+            ref_buf[b + pos] = dst_buf[a + pos] - 1;
+            if (sign (k_memcmp (dst_buf + a, ref_buf + b, len))
+                != sign (memcmp (dst_buf + a, ref_buf + b, len)))
+              fail ("memcmp with smaller byte in B", a, b, len);
+            ref_buf[b + pos] = saved;
+          }
+      }
+}
+
+static void
+test_strlen (size_t len)
+{
+  size_t a;
+
+  for (a = 0; a < ALIGN_CNT; a++)
+    {
+      memcpy (dst_buf, src_buf, BUF_SIZE);
+      dst_buf[a + len] = '\0';
+      if (k_strlen ((char *) dst_buf + a) != len)
+        fail ("strlen", a, a, len);
+    }
+}
+
+int
+main (void)
+{
+  srand (1);
+  fill (src_buf, BUF_SIZE);
+
+  for_each_length (test_memcpy);
+  for_each_length (test_memmove);
+  for_each_length (test_memset);
+  for_each_length (test_memcmp);
+  for_each_length (test_strlen);
+
+  if (failures)
+    {
+      printf ("%d failures\n", failures);
+      return 1;
+    }
+  printf ("PASS\n");
+  return 0;
+}
@@ -0,0 +1,85 @@
+/* Puts a large number of threads to sleep at once, for durations
+   spread over more than one revolution of the timer wheel, and
+   verifies that every thread wakes up and that none wakes up
+   early. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define THREAD_CNT 1000
+#define MAX_SLEEP 600
+
+/* Information about the test. */
+struct sleep_test 
+  {
+    int64_t start;              /* Current time at start of test. */
+    struct lock lock;           /* Protects EARLY_CNT. */
+    int early_cnt;              /* Number of threads that woke early. */
+    struct semaphore done;      /* Upped once by each thread. */
+  };
+
+/* Information about an individual thread in the test. */
+struct sleep_thread 
+  {
+    struct sleep_test *test;    /* Info shared between all threads. */
+    int duration;               /* Number of ticks to sleep. */
+  };
+
+static struct sleep_thread threads[THREAD_CNT];
+
+static void sleeper (void *);
+
+void
+test_alarm_stress (void) 
+{
+  struct sleep_test test;
+  int i;
+
+  msg ("Sleeping %d threads for 1 to %d ticks each.", THREAD_CNT, MAX_SLEEP);
+
+  test.start = timer_ticks () + 100;
+  lock_init (&test.lock);
+  test.early_cnt = 0;
+  sema_init (&test.done, 0);
+
+  for (i = 0; i < THREAD_CNT; i++) 
+    {
+      struct sleep_thread *t = &threads[i];
+      char name[16];
+
+      t->test = &test;
+      t->duration = i * 7 % MAX_SLEEP + 1;
+      snprintf (name, sizeof name, "sleeper %d", i);
+      if (thread_create (name, PRI_DEFAULT, sleeper, t) == TID_ERROR)
+        fail ("could not create thread %d", i);
+    }
+
+  for (i = 0; i < THREAD_CNT; i++)
+    sema_down (&test.done);
+
+  if (test.early_cnt != 0)
+    fail ("%d threads woke up early", test.early_cnt);
+  msg ("All %d threads woke up, none early.", THREAD_CNT);
+}
+
+/* Sleeper thread. */
+static void
+sleeper (void *t_) 
+{
+  struct sleep_thread *t = t_;
+  struct sleep_test *test = t->test;
+  int64_t sleep_until = test->start + t->duration;
+
+  timer_sleep (sleep_until - timer_ticks ());
+  if (timer_ticks () < sleep_until) 
+    {
+      lock_acquire (&test->lock);
+      test->early_cnt++;
+      lock_release (&test->lock);
+    }
+  sema_up (&test->done);
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(alarm-stress) begin
+(alarm-stress) Sleeping 1000 threads for 1 to 600 ticks each.
+(alarm-stress) All 1000 threads woke up, none early.
+(alarm-stress) end
+EOF
+pass;
@@ -32,9 +32,6 @@
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 
-/* Maximum level of nesting for priority donation. */
-#define NESTING_DEPTH 8
-
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
    manipulating it:
@@ -53,42 +50,61 @@ sema_init (struct semaphore *sema, unsigned value)
   list_init (&sema->waiters);
 }
 
-/* Higher priority thread donates its priority if it is blocked
- * on a lock acquired by a lower priority thread. It checks for
- * possible nested priority donations upto NESTING_DEPTH. */
+/* Donates priority P along the chain of locks starting at LOCK.
+ * Each lock caches the highest priority of its waiters, so the walk
+ * stops at the first lock or holder that already has at least P; an
+ * acquire costs O(depth) of the chain with no fixed nesting limit.
+ * Interrupts must be off. */
 static void
-donate_priority (void)
+donate_priority (struct lock *lock, int p)
 {
-	struct thread *curr = thread_current ();
-	struct lock *lock = curr->waiting_for_lock;
-	int depth = 0;
-	while (lock && depth < NESTING_DEPTH) {
-		if(lock->holder) {
-			if (lock->holder->priority < curr->priority) {
-				lock->holder->priority = curr->priority;
-			}
-		}
-		curr = lock->holder;
-		lock = curr->waiting_for_lock;
-		depth++;
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	while (lock != NULL && lock->max_priority < p) {
+		struct thread *holder = lock->holder;
+		lock->max_priority = p;
+		if (holder == NULL || holder->priority >= p)
+			break;
+		thread_requeue (holder, p);
+		lock = holder->waiting_for_lock;
 	}
 }
 
-/* Updates priority back to original priority after lock release or explicit
- * call from thread_set_priority(). During nested donations, updates the
- * current thread priority to highest priority of element in its donor list.
- */
+/* Recomputes the current thread's priority after a lock release or an
+ * explicit call from thread_set_priority(): the larger of its original
+ * priority and the highest waiter priority over the locks it holds. */
 void
 update_priority ()
 {
 	struct thread *cur = thread_current ();
-	cur->priority = cur->original_priority;
-	if (!list_empty (&cur->donor_list)) {
-		struct thread *top_donor = list_entry (list_front (&cur->donor_list),
-				struct thread, donor_elem);
-		if (cur->priority < top_donor->priority)
-			cur->priority = top_donor->priority;
+	struct list_elem *e;
+	int p;
+	if (thread_mlfqs)
+		return;
+	p = cur->original_priority;
+	for (e = list_begin (&cur->held_locks); e != list_end (&cur->held_locks);
+			e = list_next (e)) {
+		struct lock *l = list_entry (e, struct lock, elem);
+		if (l->max_priority > p)
+			p = l->max_priority;
 	}
+	cur->priority = p;
+}
+
+/* Returns the highest priority among the threads waiting on LOCK,
+ * or PRI_MIN if there are none. */
+static int
+waiters_max_priority (struct lock *lock)
+{
+	struct list *waiters = &lock->semaphore.waiters;
+	struct list_elem *e;
+	int p = PRI_MIN;
+	for (e = list_begin (waiters); e != list_end (waiters); e = list_next (e)) {
+		struct thread *t = list_entry (e, struct thread, elem);
+		if (t->priority > p)
+			p = t->priority;
+	}
+	return p;
 }
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
@@ -109,12 +125,10 @@ sema_down (struct semaphore *sema)
   old_level = intr_disable ();
   while (sema->value == 0) 
     {
-	  donate_priority();
-//      list_push_back (&sema->waiters, &thread_current ()->elem);
-      list_insert_ordered (&sema->waiters,
-    		  &thread_current ()->elem,
-			  (list_less_func *) &compare_priority,
-			  NULL);
+      /* Waiters are kept in arrival order; sema_up() picks the
+         highest priority one, since donations can change
+         priorities while threads wait. */
+      list_push_back (&sema->waiters, &thread_current ()->elem);
       thread_block ();
     }
   sema->value--;
@@ -159,9 +173,12 @@ sema_up (struct semaphore *sema)
   old_level = intr_disable ();
 
   if (!list_empty (&sema->waiters)) {
-	list_sort (&sema->waiters, (list_less_func *) &compare_priority, NULL);
-    struct thread *waiter_thread = list_entry (list_pop_front (&sema->waiters),
+    /* compare_priority() orders higher priorities first, so the
+       "minimum" is the earliest waiter of highest priority. */
+    struct thread *waiter_thread = list_entry (list_min (&sema->waiters,
+                                (list_less_func *) &compare_priority, NULL),
                                 struct thread, elem);
+    list_remove (&waiter_thread->elem);
     thread_unblock (waiter_thread);
   }
 
@@ -234,23 +251,10 @@ lock_init (struct lock *lock)
   ASSERT (lock != NULL);
 
   lock->holder = NULL;
+  lock->max_priority = PRI_MIN;
   sema_init (&lock->semaphore, 1);
 }
 
-/* If the thread is blocked on any lock, it adds itself to
- * the lock holder's donor list. */
-static void
-add_to_donor_list (struct lock *lock)
-{
-	if (lock->holder) {
-		thread_current ()->waiting_for_lock = lock;
-		list_insert_ordered (&lock->holder->donor_list,
-				&thread_current ()->donor_elem,
-				(list_less_func *) &compare_priority,
-				NULL);
-	  }
-}
-
 /* Acquires LOCK, sleeping until it becomes available if
    necessary.  The lock must not already be held by the current
    thread.
@@ -262,14 +266,28 @@ add_to_donor_list (struct lock *lock)
 void
 lock_acquire (struct lock *lock)
 {
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
 
-  add_to_donor_list(lock);
+  old_level = intr_disable ();
+  /* There is no priority donation under the MLFQS scheduler. */
+  if (!thread_mlfqs && lock->holder != NULL)
+    {
+      cur->waiting_for_lock = lock;
+      donate_priority (lock, cur->priority);
+    }
   sema_down (&lock->semaphore);
-  lock->holder = thread_current ();
-  thread_current ()->waiting_for_lock = NULL;
+  cur->waiting_for_lock = NULL;
+  lock->holder = cur;
+  lock->max_priority = waiters_max_priority (lock);
+  list_push_back (&cur->held_locks, &lock->elem);
+  if (!thread_mlfqs && cur->priority < lock->max_priority)
+    cur->priority = lock->max_priority;
+  intr_set_level (old_level);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -281,34 +299,24 @@ lock_acquire (struct lock *lock)
 bool
 lock_try_acquire (struct lock *lock)
 {
+  enum intr_level old_level;
   bool success;
 
   ASSERT (lock != NULL);
   ASSERT (!lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
   success = sema_try_down (&lock->semaphore);
   if (success)
-    lock->holder = thread_current ();
+    {
+      lock->holder = thread_current ();
+      lock->max_priority = PRI_MIN;
+      list_push_back (&thread_current ()->held_locks, &lock->elem);
+    }
+  intr_set_level (old_level);
   return success;
 }
 
-/* After a thread releases a lock, it removes all the threads
- * waiting on this lock from the lock holder's donor list. */
-static void
-remove_from_donor_list (struct lock *lock)
-{
-	struct thread *lock_holder = lock->holder;
-	struct list_elem *e;
-	for (e = list_begin (&lock_holder->donor_list);
-			e != list_end (&lock_holder->donor_list);
-			e = list_next (e)) {
-		 struct thread *t = list_entry (e, struct thread, donor_elem);
-		 if (t->waiting_for_lock == lock) {
-			 list_remove (e);
-		 }
-	}
-}
-
 /* Releases LOCK, which must be owned by the current thread.
 
    An interrupt handler cannot acquire a lock, so it does not
@@ -320,13 +328,17 @@ lock_release (struct lock *lock)
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
-  /* Remove thread from donor_list waiting on this lock. */
-  remove_from_donor_list (lock);
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  list_remove (&lock->elem);
   lock->holder = NULL;
-  /* Current thread's priority is updated to highest priority thread present
-   * in donor_list or set to original priority. */
+  lock->max_priority = PRI_MIN;
+  /* Drop whatever this lock donated; the priority falls back to the
+     highest donation through the remaining held locks. */
   update_priority ();
   sema_up (&lock->semaphore);
+  intr_set_level (old_level);
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -11,6 +11,7 @@
 #include "threads/switch.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
+#include "devices/timer.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
@@ -20,13 +21,23 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
-
-/* Used for timer_sleep. Contains a sorted list of threads
-   that are in sleeping state based on their wake up time. */
-static struct list blocked_list;
+/* Run queue: processes in THREAD_READY state, that is, processes
+   that are ready to run but not actually running.  There is one
+   FIFO list per priority, and bit P of ready_bitmap is set
+   exactly when ready_lists[P] is nonempty, so finding the highest
+   priority ready thread takes a bit scan instead of a list walk. */
+static struct list ready_lists[PRI_MAX + 1];
+static uint64_t ready_bitmap;
+static int ready_cnt;           /* # of threads in the run queue. */
+
+/* Used for timer_sleep.  A hashed timing wheel: a thread sleeping
+   until tick T waits in slot T % TIMER_WHEEL_SIZE, so putting a
+   thread to sleep or taking it off the wheel is O(1), and a tick
+   only looks at the sleepers in its own slot.  A sleeper due more
+   than one revolution ahead stays put until its round comes up. */
+#define TIMER_WHEEL_SIZE 256            /* Must be a power of 2. */
+static struct list timer_wheel[TIMER_WHEEL_SIZE];
+static int64_t timer_wheel_now;         /* Last tick expired. */
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
@@ -63,6 +74,17 @@ static unsigned thread_ticks;   /* # of timer ticks since last yield. */
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* Multilevel feedback queue scheduler.  LOAD_AVG estimates the
+   number of threads ready to run over the past minute. */
+#define MLFQS_PRIORITY_TICKS 4  /* # of ticks between priority updates. */
+static fixed_t load_avg;
+
+static void mlfqs_tick (struct thread *);
+static void yield_on_return (void);
+static int mlfqs_priority (const struct thread *);
+static void mlfqs_update_priority (struct thread *);
+static void mlfqs_decay (struct thread *, void *coefficient);
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
@@ -74,6 +96,9 @@ static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
+static void ready_push (struct thread *);
+static void ready_remove (struct thread *);
+static int ready_top_priority (void);
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
@@ -91,12 +116,20 @@ static tid_t allocate_tid (void);
 void
 thread_init (void) 
 {
+  int i;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
+  for (i = PRI_MIN; i <= PRI_MAX; i++)
+    list_init (&ready_lists[i]);
+  ready_bitmap = 0;
+  ready_cnt = 0;
+  load_avg = 0;
   list_init (&all_list);
-  list_init (&blocked_list);
+  for (i = 0; i < TIMER_WHEEL_SIZE; i++)
+    list_init (&timer_wheel[i]);
+  timer_wheel_now = 0;
 
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
@@ -139,11 +172,102 @@ thread_tick (void)
   else
     kernel_ticks++;
 
+  if (thread_mlfqs)
+    mlfqs_tick (t);
+
   /* Enforce preemption. */
   if (++thread_ticks >= TIME_SLICE)
+    yield_on_return ();
+}
+
+/* Asks for the running thread to yield when the timer interrupt
+   returns.  thread_tick() also runs outside interrupt context, when
+   the idle thread catches up on ticks it slept through (see
+   timer_idle_exit()); the idle thread gives up the CPU right after
+   that anyway. */
+static void
+yield_on_return (void)
+{
+  if (intr_context ())
     intr_yield_on_return ();
 }
 
+/* Does the per-tick bookkeeping of the multilevel feedback queue
+   scheduler for running thread CUR.  Only CUR's recent_cpu
+   changes between one-second boundaries, so only CUR's priority is
+   recomputed every MLFQS_PRIORITY_TICKS ticks; every thread is
+   visited just once a second, when load_avg is updated and
+   recent_cpu decays.  Runs in the timer interrupt. */
+static void
+mlfqs_tick (struct thread *cur)
+{
+  int64_t ticks = timer_ticks ();
+
+  if (cur != idle_thread)
+    cur->recent_cpu = fp_add_int (cur->recent_cpu, 1);
+
+  if (ticks % TIMER_FREQ == 0)
+    {
+      int ready_threads = ready_cnt + (cur != idle_thread ? 1 : 0);
+      fixed_t twice_load;
+      fixed_t coefficient;
+
+      load_avg = fp_mul (fp_div (fp_from_int (59), fp_from_int (60)), load_avg)
+                 + fp_from_int (ready_threads) / 60;
+      twice_load = 2 * load_avg;
+      coefficient = fp_div (twice_load, fp_add_int (twice_load, 1));
+      thread_foreach (mlfqs_decay, &coefficient);
+    }
+  else if (ticks % MLFQS_PRIORITY_TICKS == 0 && cur != idle_thread)
+    mlfqs_update_priority (cur);
+  else
+    return;
+
+  if (cur->priority < get_top_thread_priority ())
+    yield_on_return ();
+}
+
+/* Decays T's recent_cpu by *COEFFICIENT_ and recomputes its
+   priority.  Called once a second for every thread. */
+static void
+mlfqs_decay (struct thread *t, void *coefficient_)
+{
+  fixed_t *coefficient = coefficient_;
+
+  if (t == idle_thread)
+    return;
+  t->recent_cpu = fp_add_int (fp_mul (*coefficient, t->recent_cpu), t->nice);
+  mlfqs_update_priority (t);
+}
+
+/* Returns the MLFQS priority for T's recent_cpu and nice values. */
+static int
+mlfqs_priority (const struct thread *t)
+{
+  int priority = PRI_MAX - fp_trunc (t->recent_cpu / 4) - t->nice * 2;
+
+  if (priority < PRI_MIN)
+    return PRI_MIN;
+  if (priority > PRI_MAX)
+    return PRI_MAX;
+  return priority;
+}
+
+/* Recomputes T's priority from its recent_cpu and nice values,
+   moving T between run queues if it changed. */
+static void
+mlfqs_update_priority (struct thread *t)
+{
+  int priority = mlfqs_priority (t);
+
+  if (priority != t->priority)
+    {
+      enum intr_level old_level = intr_disable ();
+      thread_requeue (t, priority);
+      intr_set_level (old_level);
+    }
+}
+
 /* Prints thread statistics. */
 void
 thread_print_stats (void) 
@@ -214,19 +338,6 @@ thread_create (const char *name, int priority,
   return tid;
 }
 
-/* Compares two thread elements based on their
- * wake_up_time. Returns true if thread1's
- * wake_up_time is smaller than thread2's wake_up_time. */
-static bool
-compare_ticks(const struct list_elem *a,
-		const struct list_elem *b,
-		void *aux UNUSED)
-{
-	 struct thread *threadA = list_entry(a, struct thread, blocked_elem);
-	 struct thread *threadB = list_entry(b, struct thread, blocked_elem);
-	 return (threadA->wake_up_time < threadB->wake_up_time);
-}
-
 /* Compares two thread elements based on their
  * priorities. Returns true if thread1's
  * priority is greater than thread2's priority. */
@@ -240,21 +351,21 @@ compare_priority (const struct list_elem *a,
 	 return (threadA->priority > threadB->priority);
 }
 
-/* Thread sleeps (blocked) until wake_time.
- * Inserts current thread into blocked_list in
- * order sorted by wake_time. */
+/* Thread sleeps (blocked) until wake_time.  The current
+   thread is put on the timer wheel slot for wake_time; it
+   returns at once if that tick has already been expired. */
 void
 thread_sleep (const int64_t wake_time)
 {
 	enum intr_level old_level;
-	old_level = intr_disable();
-	thread_current ()->wake_up_time = wake_time;
-	list_insert_ordered(&blocked_list,
-			&thread_current ()->blocked_elem,
-			(list_less_func *) &compare_ticks,
-			NULL);
-	thread_block();
-	intr_set_level(old_level);
+	old_level = intr_disable ();
+	if (wake_time > timer_wheel_now) {
+		thread_current ()->wake_up_time = wake_time;
+		list_push_back (&timer_wheel[wake_time & (TIMER_WHEEL_SIZE - 1)],
+				&thread_current ()->blocked_elem);
+		thread_block ();
+	}
+	intr_set_level (old_level);
 }
 
 /* Puts the current thread to sleep.  It will not be scheduled
@@ -290,38 +401,65 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-//  list_push_back (&ready_list, &t->elem);
-
-  /* Inserting threads in sorted order (based on their priority into
-   * ready list. This will ensure removal of highest priority thread. */
-  list_insert_ordered(&ready_list, &t->elem,
-		  (list_less_func *) &compare_priority,
-		  NULL);
+  ready_push (t);
   t->status = THREAD_READY;
   intr_set_level (old_level);
 }
 
-/* If current time >= thread's wake_up_time
- * then remove the thread from the blocked list
- * and unblock it. */
+/* Wakes up every sleeping thread whose wake_up_time is at or
+   before current_time.  Each slot passed since the last call is
+   expired in turn; after a gap of a full revolution or more,
+   every slot is looked at exactly once. */
 void
 remove_from_blocked_list (int64_t current_time)
 {
-	if (!list_empty (&blocked_list)) {
+	int64_t tick = timer_wheel_now;
+
+	if (current_time - tick > TIMER_WHEEL_SIZE)
+		tick = current_time - TIMER_WHEEL_SIZE;
+	while (tick < current_time) {
+		struct list *slot;
 		struct list_elem *e;
-		for (e=list_begin (&blocked_list);
-				e!=list_end (&blocked_list);
-				e = list_next (e)) {
-			struct thread *blocked_thread = list_entry (e,
-					struct thread, blocked_elem);
+
+		tick++;
+		slot = &timer_wheel[tick & (TIMER_WHEEL_SIZE - 1)];
+		for (e = list_begin (slot); e != list_end (slot);) {
+			struct thread *blocked_thread =
+					list_entry (e, struct thread, blocked_elem);
 			if (current_time >= blocked_thread->wake_up_time) {
-				list_remove (&blocked_thread->blocked_elem);
+				e = list_remove (e);
 				thread_unblock (blocked_thread);
 			} else {
-				break;
+				e = list_next (e);
 			}
 		}
 	}
+	if (current_time > timer_wheel_now)
+		timer_wheel_now = current_time;
+}
+
+/* Returns the earliest tick after the last one expired at which
+   a sleeping thread is due, or LIMIT if none is due before it.
+   Looks at one timer wheel slot per tick.  Interrupts must be
+   off. */
+int64_t
+thread_next_wakeup (int64_t limit)
+{
+	int64_t tick;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	for (tick = timer_wheel_now + 1;
+			tick < limit && tick - timer_wheel_now <= TIMER_WHEEL_SIZE;
+			tick++) {
+		struct list *slot = &timer_wheel[tick & (TIMER_WHEEL_SIZE - 1)];
+		struct list_elem *e;
+		for (e = list_begin (slot); e != list_end (slot); e = list_next (e)) {
+			if (list_entry (e, struct thread, blocked_elem)->wake_up_time <= tick)
+				return tick;
+		}
+	}
+	return limit;
 }
 
 /* Returns the name of the running thread. */
@@ -389,13 +527,8 @@ thread_yield (void)
   ASSERT (!intr_context ());
 
   old_level = intr_disable ();
-  if (cur != idle_thread) {
-	  //    list_push_back (&ready_list, &cur->elem);
-	  /* Inserting threads in sorted order (based on their priority into
-	   * ready list. This will ensure removal of highest priority thread. */
-	  list_insert_ordered(&ready_list, &cur->elem,
-	  	  		  (list_less_func *) &compare_priority, NULL);
-  }
+  if (cur != idle_thread)
+    ready_push (cur);
   cur->status = THREAD_READY;
   schedule ();
   intr_set_level (old_level);
@@ -425,6 +558,9 @@ void
 thread_set_priority (int new_priority) 
 {
 	enum intr_level old_level;
+	/* The MLFQS scheduler computes priorities itself. */
+	if (thread_mlfqs)
+		return;
 	old_level = intr_disable();
 	thread_current ()->priority = new_priority;
 	thread_current ()->original_priority = new_priority;
@@ -443,37 +579,55 @@ thread_get_priority (void)
   return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE and recomputes its
+   priority, yielding if it no longer has the highest priority. */
 void
-thread_set_nice (int nice UNUSED) 
+thread_set_nice (int nice) 
 {
-  /* Not yet implemented. */
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (NICE_MIN <= nice && nice <= NICE_MAX);
+
+  old_level = intr_disable ();
+  cur->nice = nice;
+  /* Only the MLFQS scheduler derives priorities from nice. */
+  if (thread_mlfqs)
+    {
+      mlfqs_update_priority (cur);
+      if (cur->priority < get_top_thread_priority ())
+        thread_yield ();
+    }
+  intr_set_level (old_level);
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int load_avg_100 = fp_round (load_avg * 100);
+  intr_set_level (old_level);
+  return load_avg_100;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int recent_cpu_100 = fp_round (thread_current ()->recent_cpu * 100);
+  intr_set_level (old_level);
+  return recent_cpu_100;
 }
-
+
 /* Idle thread.  Executes when no other thread is ready to run.
 
    The idle thread is initially put on the ready list by
@@ -494,8 +648,13 @@ idle (void *idle_started_ UNUSED)
     {
       /* Let someone else run. */
       intr_disable ();
+      timer_idle_exit ();
       thread_block ();
 
+      /* Nothing else is ready: stop the periodic tick until the
+         next sleeping thread is due. */
+      timer_idle_enter ();
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -563,9 +722,19 @@ init_thread (struct thread *t, const char *name, int priority)
   t->original_priority = priority;
   t->waiting_for_lock = NULL;
   t->wake_up_time = 0;
-  list_init (&t->donor_list);
+  list_init (&t->held_locks);
   t->magic = THREAD_MAGIC;
 
+  /* New threads inherit the creator's nice and recent_cpu values;
+     the initial thread starts from zero. */
+  if (t != running_thread ())
+    {
+      t->nice = thread_current ()->nice;
+      t->recent_cpu = thread_current ()->recent_cpu;
+    }
+  if (thread_mlfqs)
+    t->priority = t->original_priority = mlfqs_priority (t);
+
   old_level = intr_disable ();
   list_push_back (&all_list, &t->allelem);
   intr_set_level (old_level);
@@ -592,10 +761,69 @@ alloc_frame (struct thread *t, size_t size)
 static struct thread *
 next_thread_to_run (void) 
 {
-  if (list_empty (&ready_list))
+  int priority = ready_top_priority ();
+  struct thread *t;
+
+  if (priority < 0)
     return idle_thread;
+
+  t = list_entry (list_front (&ready_lists[priority]), struct thread, elem);
+  ready_remove (t);
+  return t;
+}
+
+/* Appends T to the run queue for its priority. */
+static void
+ready_push (struct thread *t)
+{
+  list_push_back (&ready_lists[t->priority], &t->elem);
+  ready_bitmap |= (uint64_t) 1 << t->priority;
+  ready_cnt++;
+}
+
+/* Takes T off the run queue. */
+static void
+ready_remove (struct thread *t)
+{
+  list_remove (&t->elem);
+  ready_cnt--;
+  if (list_empty (&ready_lists[t->priority]))
+    ready_bitmap &= ~((uint64_t) 1 << t->priority);
+}
+
+/* Returns the highest priority with a ready thread, or -1 if the
+   run queue is empty. */
+static int
+ready_top_priority (void)
+{
+  uint32_t high = ready_bitmap >> 32;
+  uint32_t low = ready_bitmap;
+
+  if (high != 0)
+    return 63 - __builtin_clz (high);
+  if (low != 0)
+    return 31 - __builtin_clz (low);
+  return -1;
+}
+
+/* Changes the priority of thread T to PRIORITY, moving T to the
+   matching run queue if it is ready.  Used for priority donation,
+   where T need not be the running thread.  Interrupts must be
+   off. */
+void
+thread_requeue (struct thread *t, int priority)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+
+  if (t->status == THREAD_READY)
+    {
+      ready_remove (t);
+      t->priority = priority;
+      ready_push (t);
+    }
   else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+    t->priority = priority;
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -681,17 +909,13 @@ allocate_tid (void)
   return tid;
 }
 
-/* Returns the priority of the first element in the ready list
- * (i.e. highest priority). If ready list is empty return PRI_MIN. */
+/* Returns the priority of the highest priority ready thread.
+ * If the run queue is empty return PRI_MIN. */
 int
 get_top_thread_priority ()
 {
-	if (!list_empty (&ready_list)) {
-		struct thread *t = list_entry (list_front (&ready_list),
-			                                  struct thread, elem);
-		return t->priority;
-	}
-	return PRI_MIN;
+	int priority = ready_top_priority ();
+	return priority < 0 ? PRI_MIN : priority;
 }
 
 
@@ -4,6 +4,7 @@
 #include <debug.h>
 #include <list.h>
 #include <stdint.h>
+#include "threads/fixed-point.h"
 
 /* States in a thread's life cycle. */
 enum thread_status
@@ -24,6 +25,11 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Thread niceness, for the multilevel feedback queue scheduler. */
+#define NICE_MIN -20                    /* Nicest. */
+#define NICE_DEFAULT 0                  /* Default niceness. */
+#define NICE_MAX 20                     /* Least nice. */
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -100,9 +106,12 @@ struct thread
     /* For priority scheduling and donations. */
     int original_priority;              /* Saves original priority during donations. */
     struct lock *waiting_for_lock;      /* Lock on which the thread is blocked. */
-    struct list donor_list;             /* All high priority threads that are blocked
-    									 * and eligible for donating their priority. */
-    struct list_elem donor_elem;        /* List element for donor thread. */
+    struct list held_locks;             /* Locks held, each caching the highest
+                                           priority of its waiters. */
+
+    /* For the multilevel feedback queue scheduler. */
+    int nice;                           /* Niceness, -20 to 20. */
+    fixed_t recent_cpu;                 /* Recent CPU time received. */
 
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
@@ -151,9 +160,11 @@ int thread_get_load_avg (void);
 
 void thread_sleep (const int64_t);
 void remove_from_blocked_list(int64_t);
+int64_t thread_next_wakeup (int64_t limit);
 bool compare_priority(const struct list_elem *a,
 		const struct list_elem *b,
 		void *aux UNUSED);
 int get_top_thread_priority(void);
+void thread_requeue (struct thread *, int priority);
 
 #endif /* threads/thread.h */
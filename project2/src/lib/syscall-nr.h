@@ -28,7 +28,13 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Batched I/O. */
+    SYS_READV,                  /* Read from a file into many buffers. */
+    SYS_WRITEV,                 /* Write to a file from many buffers. */
+    SYS_PREAD,                  /* Read from a file at an offset. */
+    SYS_PWRITE                  /* Write to a file at an offset. */
   };
 
 #endif /* lib/syscall-nr.h */
@@ -0,0 +1,27 @@
+/* Executes and waits for a small child process many times in a
+   row, so that the run is dominated by the cost of loading the
+   executable.  The kernel adds up the timer ticks each exec
+   takes until the child has loaded and prints the total on the
+   "Exec:" line at power-off; compare it between kernels to
+   measure exec latency. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define EXEC_CNT 32
+
+void
+test_main (void) 
+{
+  int i;
+
+  for (i = 0; i < EXEC_CNT; i++)
+    {
+      pid_t pid = exec ("child-simple");
+      if (pid == PID_ERROR)
+        fail ("exec #%d failed", i);
+      if (wait (pid) != 81)
+        fail ("wrong exit code from exec #%d", i);
+    }
+}
@@ -0,0 +1,9 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($expected) = "(exec-latency) begin\n";
+$expected .= "(child-simple) run\nchild-simple: exit(81)\n" foreach 1...32;
+$expected .= "(exec-latency) end\nexec-latency: exit(0)\n";
+check_expected ([$expected]);
+pass;
@@ -2,11 +2,13 @@
 #include <debug.h>
 #include <stddef.h>
 #include <random.h>
+#include <round.h>
 #include <stdio.h>
 #include <string.h>
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
+#include "threads/loader.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/switch.h"
@@ -30,6 +32,17 @@ static struct list ready_list;
    when they are first scheduled and removed when they exit. */
 static struct list all_list;
 
+/* Threads hashed by tid, so that retrieve_thread() need not scan
+   all_list.  Tids are handed out in sequence, so their low bits
+   spread them evenly.  Every thread takes a page of memory, so
+   there cannot be more threads than pages; the table has at least
+   one bucket per page of RAM, and a lookup examines about one
+   thread.  It is allocated by thread_start().  A thread is in the
+   table from the time its tid is assigned until it exits; like
+   all_list, the table is only touched with interrupts off. */
+static struct list *tid_table;
+static size_t tid_table_size;           /* A power of 2. */
+
 /* Idle thread. */
 static struct thread *idle_thread;
 
@@ -75,6 +88,7 @@ static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
+static void tid_table_insert (struct thread *);
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
@@ -106,10 +120,22 @@ thread_init (void)
 }
 
 /* Starts preemptive thread scheduling by enabling interrupts.
-   Also creates the idle thread. */
+   Also allocates the tid table and creates the idle thread. */
 void
 thread_start (void) 
 {
+	size_t i;
+
+	/* Allocate the tid table and enter the running thread. */
+	tid_table_size = 1;
+	while (tid_table_size < init_ram_pages)
+		tid_table_size *= 2;
+	tid_table = palloc_get_multiple (PAL_ASSERT,
+			DIV_ROUND_UP (tid_table_size * sizeof *tid_table, PGSIZE));
+	for (i = 0; i < tid_table_size; i++)
+		list_init (&tid_table[i]);
+	tid_table_insert (initial_thread);
+
 	/* Create the idle thread. */
 	struct semaphore idle_started;
 	sema_init (&idle_started, 0);
@@ -200,6 +226,7 @@ thread_create (const char *name, int priority,
 	/* Initialize thread. */
 	init_thread (t, name, priority);
 	tid = t->tid = allocate_tid ();
+	tid_table_insert (t);
 
 	/* Stack frame for kernel_thread(). */
 	kf = alloc_frame (t, sizeof *kf);
@@ -313,6 +340,7 @@ thread_exit (void)
      when it calls thread_schedule_tail(). */
 	intr_disable ();
 	list_remove (&thread_current()->allelem);
+	list_remove (&thread_current ()->tidelem);
 	thread_current ()->status = THREAD_DYING;
 	schedule ();
 	NOT_REACHED ();
@@ -486,8 +514,7 @@ init_thread (struct thread *t, const char *name, int priority)
 	list_push_back (&all_list, &t->allelem);
 	lock_init(&t->wait_lock);
 
-	list_init (&t->opened_file_list);
-	t->fd = 2; // minimum fd value to start from.
+	t->fd_table = NULL; // created by the first open().
  	list_init (&t->child_list);
 	t->parent = -1;
 }
@@ -606,22 +633,37 @@ allocate_tid (void)
    Used by switch.S, which can't figure it out on its own. */
 uint32_t thread_stack_ofs = offsetof (struct thread, stack);
 
+/* Adds T, whose tid has just been assigned, to the tid table. */
+static void
+tid_table_insert (struct thread *t)
+{
+	enum intr_level old_level = intr_disable ();
+	list_push_back (&tid_table[t->tid & (tid_table_size - 1)], &t->tidelem);
+	intr_set_level (old_level);
+}
+
 /*
- * Given a pid, return the corresponding thread from all_list.
+ * Given a pid, return the corresponding thread, or NULL if no
+ * live thread has it.  Looks in the tid table; all_list is only
+ * walked for diagnostics.
  */
 struct thread*
 retrieve_thread (int pid)
 {
+	struct list *bucket = &tid_table[pid & (tid_table_size - 1)];
+	struct thread *found = NULL;
 	struct list_elem *e;
-	for (e = list_begin (&all_list);
-			e != list_end (&all_list);
-			e = list_next (e)) {
-		struct thread *t = list_entry (e, struct thread, allelem);
+	enum intr_level old_level = intr_disable ();
+
+	for (e = list_begin (bucket); e != list_end (bucket); e = list_next (e)) {
+		struct thread *t = list_entry (e, struct thread, tidelem);
 		if (t->tid == pid) {
-			return t;
+			found = t;
+			break;
 		}
 	}
-	return NULL;
+	intr_set_level (old_level);
+	return found;
 }
 
 /*
@@ -90,6 +90,7 @@ struct thread
 	uint8_t *stack;                     /* Saved stack pointer. */
 	int priority;                       /* Priority. */
 	struct list_elem allelem;           /* List element for all threads list. */
+	struct list_elem tidelem;           /* List element for tid table. */
 
 	/* Shared between thread.c and synch.c. */
 	struct list_elem elem;              /* List element. */
@@ -103,8 +104,7 @@ struct thread
 	unsigned magic;                     /* Detects stack overflow. */
 
 	// Needed for file system sys calls
-	struct list opened_file_list;       /* Keeps track of files opened by a thread. */
-	int fd;                             /* File descriptor */
+	struct fd_table *fd_table;          /* Files opened by a thread, by fd. */
 
 	// Needed for wait / exec sys calls
 	struct list child_list;             /* Keeps track of child processes of a thread */
@@ -284,6 +284,9 @@ struct Elf32_Phdr
 #define WORD_SIZE 4
 #define DEFAULT_ARGV 2
 
+/* Maximum number of pages load_segment() reads with one call. */
+#define LOAD_BATCH_PAGES 16
+
 static bool setup_stack (char *file_name, void **esp);
 static void stack_setup_for_args (char *str_token, char *token_ptr, void **esp);
 static bool validate_segment (const struct Elf32_Phdr *, struct file *);
@@ -301,7 +304,8 @@ load (const char *file_name, void (**eip) (void), void **esp)
 	struct thread *t = thread_current ();
 	struct Elf32_Ehdr ehdr;
 	struct file *file = NULL;
-	off_t file_ofs;
+	struct Elf32_Phdr *phdrs = NULL;
+	off_t phdrs_size;
 	bool success = false;
 	int i;
 	char *fn_copy, *func_name;
@@ -339,19 +343,22 @@ load (const char *file_name, void (**eip) (void), void **esp)
 		goto done;
 	}
 
-	/* Read program headers. */
-	file_ofs = ehdr.e_phoff;
-	for (i = 0; i < ehdr.e_phnum; i++)
+	/* Read all the program headers with a single call instead of
+	   a seek and a read per header. */
+	phdrs_size = ehdr.e_phnum * sizeof *phdrs;
+	if (ehdr.e_phoff > (Elf32_Off) file_length (file))
+		goto done;
+	if (phdrs_size > 0)
 	{
-		struct Elf32_Phdr phdr;
-
-		if (file_ofs < 0 || file_ofs > file_length (file))
+		phdrs = malloc (phdrs_size);
+		if (phdrs == NULL
+				|| file_read_at (file, phdrs, phdrs_size, ehdr.e_phoff) != phdrs_size)
 			goto done;
-		file_seek (file, file_ofs);
+	}
+	for (i = 0; i < ehdr.e_phnum; i++)
+	{
+		struct Elf32_Phdr phdr = phdrs[i];
 
-		if (file_read (file, &phdr, sizeof phdr) != sizeof phdr)
-			goto done;
-		file_ofs += sizeof phdr;
 		switch (phdr.p_type)
 		{
 		case PT_NULL:
@@ -407,10 +414,12 @@ load (const char *file_name, void (**eip) (void), void **esp)
 
 	success = true;
 	file_deny_write (file);
+	free (phdrs);
 	return success;
 
 	done:
 	/* We arrive here whether the load is successful or not. */
+	free (phdrs);
 	file_close (file);
 	return success;
 }
@@ -486,39 +495,55 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 	ASSERT (pg_ofs (upage) == 0);
 	ASSERT (ofs % PGSIZE == 0);
 
-	file_seek (file, ofs);
 	while (read_bytes > 0 || zero_bytes > 0)
 	{
-		/* Calculate how to fill this page.
-         We will read PAGE_READ_BYTES bytes from FILE
-         and zero the final PAGE_ZERO_BYTES bytes. */
-		size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-		size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
-		/* Get a page of memory. */
-		uint8_t *kpage = palloc_get_page (PAL_USER);
-		if (kpage == NULL)
-			return false;
-
-		/* Load this page. */
-		if (file_read (file, kpage, page_read_bytes) != (int) page_read_bytes)
+		/* Fill up to LOAD_BATCH_PAGES pages with one read, falling
+		   back to a single page when no contiguous run is free.
+		   We will read CHUNK_READ_BYTES bytes from FILE and zero
+		   the rest of the chunk. */
+		size_t page_cnt = (read_bytes + zero_bytes) / PGSIZE;
+		size_t chunk_read_bytes, chunk_zero_bytes;
+		uint8_t *kpages = NULL;
+		size_t i;
+
+		if (page_cnt > LOAD_BATCH_PAGES)
+			page_cnt = LOAD_BATCH_PAGES;
+		if (page_cnt > 1)
+			kpages = palloc_get_multiple (PAL_USER, page_cnt);
+		if (kpages == NULL)
 		{
-			palloc_free_page (kpage);
-			return false;
+			page_cnt = 1;
+			kpages = palloc_get_page (PAL_USER);
+			if (kpages == NULL)
+				return false;
 		}
-		memset (kpage + page_read_bytes, 0, page_zero_bytes);
+		chunk_read_bytes = read_bytes < page_cnt * PGSIZE
+				? read_bytes : page_cnt * PGSIZE;
+		chunk_zero_bytes = page_cnt * PGSIZE - chunk_read_bytes;
 
-		/* Add the page to the process's address space. */
-		if (!install_page (upage, kpage, writable))
+		/* Load this chunk. */
+		if (file_read_at (file, kpages, chunk_read_bytes, ofs)
+				!= (int) chunk_read_bytes)
 		{
-			palloc_free_page (kpage);
+			palloc_free_multiple (kpages, page_cnt);
 			return false;
 		}
+		memset (kpages + chunk_read_bytes, 0, chunk_zero_bytes);
+
+		/* Add the pages to the process's address space.  Pages
+		   already installed belong to the page directory now. */
+		for (i = 0; i < page_cnt; i++)
+			if (!install_page (upage + i * PGSIZE, kpages + i * PGSIZE, writable))
+			{
+				palloc_free_multiple (kpages + i * PGSIZE, page_cnt - i);
+				return false;
+			}
 
 		/* Advance. */
-		read_bytes -= page_read_bytes;
-		zero_bytes -= page_zero_bytes;
-		upage += PGSIZE;
+		ofs += chunk_read_bytes;
+		read_bytes -= chunk_read_bytes;
+		zero_bytes -= chunk_zero_bytes;
+		upage += page_cnt * PGSIZE;
 	}
 	return true;
 }
@@ -1,25 +1,39 @@
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 
+#include <stddef.h>
 #include "threads/synch.h"
 
 typedef int pid_t;
 /*
  * This is defined here and not in thread struct
  * because a file can be opened by multiple threads/
- * processes at a time. The list_elem in this struct
- * is stored in the threads' opened_file_list because
- * a thread too can open multiple files and it has to
- * keep track of them.
+ * processes at a time.  Each process keeps its open
+ * files in the slots of its fd_table, indexed by fd.
  */
 struct file_for_process
 {
     struct file *file;
-    int fd;
-    struct list_elem file_elem;
+};
+
+/*
+ * A process's file descriptor table: a dense array of
+ * slots indexed by fd, plus a bitmap of the slots in use
+ * so that open() hands out the lowest free fd.  The
+ * header, the slots and the bitmap share one block of
+ * PAGE_CNT pages; a full table is copied into a block
+ * twice the size.  Created on the first open().
+ */
+struct fd_table
+{
+    size_t page_cnt;                    /* Pages in this block. */
+    size_t slot_cnt;                    /* Number of SLOTS. */
+    struct bitmap *used;                /* Slots in use, fds 0 and 1 always. */
+    struct file_for_process slots[];    /* Indexed by fd. */
 };
 
 void syscall_init (void);
+void syscall_print_stats (void);
 
 void halt (void);
 void exit (int status);
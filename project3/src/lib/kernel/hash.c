@@ -18,6 +18,8 @@ static struct hash_elem *find_elem (struct hash *, struct list *,
 static void insert_elem (struct hash *, struct list *, struct hash_elem *);
 static void remove_elem (struct hash *, struct hash_elem *);
 static void rehash (struct hash *);
+static void migrate (struct hash *, size_t bucket_cnt);
+static void migrate_all (struct hash *);
 
 /* Initializes hash table H to compute hash values using HASH and
    compare hash elements using LESS, given auxiliary data AUX. */
@@ -28,6 +30,9 @@ hash_init (struct hash *h,
   h->elem_cnt = 0;
   h->bucket_cnt = 4;
   h->buckets = malloc (sizeof *h->buckets * h->bucket_cnt);
+  h->old_buckets = NULL;
+  h->old_bucket_cnt = 0;
+  h->migrate_idx = 0;
   h->hash = hash;
   h->less = less;
   h->aux = aux;
@@ -55,6 +60,7 @@ hash_clear (struct hash *h, hash_action_func *destructor)
 {
   size_t i;
 
+  migrate_all (h);
   for (i = 0; i < h->bucket_cnt; i++) 
     {
       struct list *bucket = &h->buckets[i];
@@ -88,6 +94,7 @@ hash_destroy (struct hash *h, hash_action_func *destructor)
 {
   if (destructor != NULL)
     hash_clear (h, destructor);
+  free (h->old_buckets);
   free (h->buckets);
 }
 
@@ -166,6 +173,7 @@ hash_apply (struct hash *h, hash_action_func *action)
   
   ASSERT (action != NULL);
 
+  migrate_all (h);
   for (i = 0; i < h->bucket_cnt; i++) 
     {
       struct list *bucket = &h->buckets[i];
@@ -202,6 +210,7 @@ hash_first (struct hash_iterator *i, struct hash *h)
   ASSERT (i != NULL);
   ASSERT (h != NULL);
 
+  migrate_all (h);
   i->hash = h;
   i->bucket = i->hash->buckets;
   i->elem = list_elem_to_hash_elem (list_head (i->bucket));
@@ -294,19 +303,51 @@ hash_string (const char *s_)
   return hash;
 }
 
+/* Mixes the bits of X so that every input bit affects the low
+   bits of the result, which pick the bucket.  This is the
+   finalizer of MurmurHash3. */
+static inline unsigned
+mix32 (uint32_t x) 
+{
+  x ^= x >> 16;
+  x *= 0x85ebca6bu;
+  x ^= x >> 13;
+  x *= 0xc2b2ae35u;
+  x ^= x >> 16;
+  return x;
+}
+
 /* Returns a hash of integer I. */
 unsigned
 hash_int (int i) 
 {
-  return hash_bytes (&i, sizeof i);
+  return mix32 (i);
+}
+
+/* Returns a hash of pointer P.  Much cheaper than hash_bytes()
+   on the pointer's bytes, and it spreads page-aligned addresses,
+   whose low 12 bits are all zero, across every bucket. */
+unsigned
+hash_ptr (const void *p) 
+{
+  return mix32 ((uintptr_t) p);
 }
 
-/* Returns the bucket in H that E belongs in. */
+/* Returns the bucket in H that E belongs in.  While a resize is
+   in progress, that is E's old bucket until the old bucket has
+   been migrated. */
 static struct list *
 find_bucket (struct hash *h, struct hash_elem *e) 
 {
-  size_t bucket_idx = h->hash (e, h->aux) & (h->bucket_cnt - 1);
-  return &h->buckets[bucket_idx];
+  unsigned hash = h->hash (e, h->aux);
+
+  if (h->old_buckets != NULL) 
+    {
+      size_t old_idx = hash & (h->old_bucket_cnt - 1);
+      if (old_idx >= h->migrate_idx)
+        return &h->old_buckets[old_idx];
+    }
+  return &h->buckets[hash & (h->bucket_cnt - 1)];
 }
 
 /* Searches BUCKET in H for a hash element equal to E.  Returns
@@ -344,22 +385,81 @@ is_power_of_2 (size_t x)
 #define BEST_ELEMS_PER_BUCKET 2 /* Ideal elems/bucket. */
 #define MAX_ELEMS_PER_BUCKET  4 /* Elems/bucket > 4: increase # of buckets. */
 
-/* Changes the number of buckets in hash table H to match the
-   ideal.  This function can fail because of an out-of-memory
-   condition, but that'll just make hash accesses less efficient;
-   we can still continue. */
+/* Number of old buckets moved by each modifying operation while a
+   resize is in progress.  Growth is triggered at
+   MAX_ELEMS_PER_BUCKET and aims for BEST_ELEMS_PER_BUCKET, so at
+   this rate a resize finishes long before the next is due. */
+#define MIGRATE_STEP 2
+
+/* Moves up to BUCKET_CNT of H's old buckets into the current
+   bucket array, freeing the old array once it is empty.
+
+   Both bucket counts are powers of 2, so old bucket I feeds new
+   buckets I, I + old_bucket_cnt, ... when growing, and new bucket
+   I mod bucket_cnt when shrinking.  Those new buckets are first
+   initialized here, when old bucket I is moved (or, shrinking,
+   when the lowest old bucket feeding them is), so starting a
+   resize does not have to initialize the whole new array. */
+static void
+migrate (struct hash *h, size_t bucket_cnt) 
+{
+  while (bucket_cnt-- > 0 && h->migrate_idx < h->old_bucket_cnt) 
+    {
+      size_t i = h->migrate_idx++;
+      struct list *old_bucket = &h->old_buckets[i];
+      size_t j;
+
+      for (j = i; j < h->bucket_cnt; j += h->old_bucket_cnt)
+        list_init (&h->buckets[j]);
+      while (!list_empty (old_bucket)) 
+        {
+          struct list_elem *elem = list_pop_front (old_bucket);
+          list_push_front (find_bucket (h, list_elem_to_hash_elem (elem)),
+                           elem);
+        }
+    }
+
+  if (h->migrate_idx >= h->old_bucket_cnt) 
+    {
+      free (h->old_buckets);
+      h->old_buckets = NULL;
+      h->old_bucket_cnt = 0;
+      h->migrate_idx = 0;
+    }
+}
+
+/* Finishes any resize of H in progress, so that every element is
+   in the current bucket array. */
+static void
+migrate_all (struct hash *h) 
+{
+  if (h->old_buckets != NULL)
+    migrate (h, h->old_bucket_cnt);
+}
+
+/* Advances a resize of hash table H in progress, or starts one if
+   the load factor has left [MIN_ELEMS_PER_BUCKET,
+   MAX_ELEMS_PER_BUCKET].  This function can fail because of an
+   out-of-memory condition, but that'll just make hash accesses
+   less efficient; we can still continue. */
 static void
 rehash (struct hash *h) 
 {
-  size_t old_bucket_cnt, new_bucket_cnt;
-  struct list *new_buckets, *old_buckets;
-  size_t i;
+  size_t new_bucket_cnt;
+  struct list *new_buckets;
 
   ASSERT (h != NULL);
 
-  /* Save old bucket info for later use. */
-  old_buckets = h->buckets;
-  old_bucket_cnt = h->bucket_cnt;
+  if (h->old_buckets != NULL) 
+    {
+      migrate (h, MIGRATE_STEP);
+      return;
+    }
+
+  if (h->elem_cnt <= h->bucket_cnt * MAX_ELEMS_PER_BUCKET
+      && (h->elem_cnt >= h->bucket_cnt * MIN_ELEMS_PER_BUCKET
+          || h->bucket_cnt <= 4))
+    return;
 
   /* Calculate the number of buckets to use now.
      We want one bucket for about every BEST_ELEMS_PER_BUCKET.
@@ -372,10 +472,10 @@ rehash (struct hash *h)
     new_bucket_cnt = turn_off_least_1bit (new_bucket_cnt);
 
   /* Don't do anything if the bucket count wouldn't change. */
-  if (new_bucket_cnt == old_bucket_cnt)
+  if (new_bucket_cnt == h->bucket_cnt)
     return;
 
-  /* Allocate new buckets and initialize them as empty. */
+  /* Allocate new buckets.  migrate() initializes them. */
   new_buckets = malloc (sizeof *new_buckets * new_bucket_cnt);
   if (new_buckets == NULL) 
     {
@@ -384,32 +484,15 @@ rehash (struct hash *h)
          there's no reason for it to be an error. */
       return;
     }
-  for (i = 0; i < new_bucket_cnt; i++) 
-    list_init (&new_buckets[i]);
 
-  /* Install new bucket info. */
+  /* Install new bucket info.  The elements follow a few buckets
+     at a time, starting now. */
+  h->old_buckets = h->buckets;
+  h->old_bucket_cnt = h->bucket_cnt;
+  h->migrate_idx = 0;
   h->buckets = new_buckets;
   h->bucket_cnt = new_bucket_cnt;
-
-  /* Move each old element into the appropriate new bucket. */
-  for (i = 0; i < old_bucket_cnt; i++) 
-    {
-      struct list *old_bucket;
-      struct list_elem *elem, *next;
-
-      old_bucket = &old_buckets[i];
-      for (elem = list_begin (old_bucket);
-           elem != list_end (old_bucket); elem = next) 
-        {
-          struct list *new_bucket
-            = find_bucket (h, list_elem_to_hash_elem (elem));
-          next = list_next (elem);
-          list_remove (elem);
-          list_push_front (new_bucket, elem);
-        }
-    }
-
-  free (old_buckets);
+  migrate (h, MIGRATE_STEP);
 }
 
 /* Inserts E into BUCKET (in hash table H). */
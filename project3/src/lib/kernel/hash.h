@@ -18,7 +18,14 @@
    conversion from a struct hash_elem back to a structure object
    that contains it.  This is the same technique used in the
    linked list implementation.  Refer to lib/kernel/list.h for a
-   detailed explanation. */
+   detailed explanation.
+
+   The table is resized incrementally.  When the load factor
+   leaves its bounds, a new bucket array is allocated and each
+   later insertion, replacement, or deletion moves a few
+   buckets from the old array to the new one, so no single
+   operation pays for moving every element.  Until the move is
+   done, lookups check both arrays. */
 
 #include <stdbool.h>
 #include <stddef.h>
@@ -61,6 +68,9 @@ struct hash
     size_t elem_cnt;            /* Number of elements in table. */
     size_t bucket_cnt;          /* Number of buckets, a power of 2. */
     struct list *buckets;       /* Array of `bucket_cnt' lists. */
+    struct list *old_buckets;   /* Buckets being migrated, or null. */
+    size_t old_bucket_cnt;      /* Number of buckets in old_buckets. */
+    size_t migrate_idx;         /* Old buckets below this are empty. */
     hash_hash_func *hash;       /* Hash function. */
     hash_less_func *less;       /* Comparison function. */
     void *aux;                  /* Auxiliary data for `hash' and `less'. */
@@ -99,5 +109,6 @@ bool hash_empty (struct hash *);
 unsigned hash_bytes (const void *, size_t);
 unsigned hash_string (const char *);
 unsigned hash_int (int);
+unsigned hash_ptr (const void *);
 
 #endif /* lib/kernel/hash.h */
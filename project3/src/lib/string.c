@@ -1,6 +1,99 @@
 #include <string.h>
+#include <stdint.h>
 #include <debug.h>
 
+/* The block functions below move a 32-bit word at a time once a
+   block is at least WORD_MIN bytes long, and a byte at a time
+   otherwise, where aligning would cost more than it saves.  Runs
+   of at least REP_MIN words use a REP string instruction, which
+   is fastest for long runs but slow to start. */
+#define WORD_MIN 8
+#define REP_MIN 32
+
+/* Word type for reading through a pointer of another type, at any
+   alignment.  x86 loads and stores unaligned words directly. */
+typedef uint32_t word_t __attribute__ ((may_alias, aligned (1)));
+
+/* Bytes needed to bring ADDR up to a word boundary. */
+#define WORD_GAP(ADDR) (-(uintptr_t) (ADDR) & (sizeof (word_t) - 1))
+
+/* Nonzero if any byte of word W is zero.  A byte's high bit is
+   set in W - 0x01010101 but clear in W only if the byte was zero
+   or a borrow from a lower zero byte reached it. */
+#define HAS_ZERO_BYTE(W) (((W) - 0x01010101u) & ~(W) & 0x80808080u)
+
+/* Copies SIZE bytes from SRC to DST, front to back, a byte at a
+   time until DST is word-aligned and then a word at a time, with
+   REP MOVSD for long runs.  Safe when DST precedes an overlapping
+   SRC, since each word is read before it can be overwritten. */
+static void
+copy_forward (unsigned char *dst, const unsigned char *src, size_t size)
+{
+  if (size >= WORD_MIN)
+    {
+      size_t head = WORD_GAP (dst);
+      size_t words;
+
+      size -= head;
+      while (head-- > 0)
+        *dst++ = *src++;
+
+      words = size / sizeof (word_t);
+      size %= sizeof (word_t);
+      if (words >= REP_MIN)
+        asm volatile ("rep movsl"
+                      : "+D" (dst), "+S" (src), "+c" (words) : : "memory");
+      for (; words > 0; words--)
+        {
+          *(word_t *) dst = *(const word_t *) src;
+          dst += sizeof (word_t);
+          src += sizeof (word_t);
+        }
+    }
+  while (size-- > 0)
+    *dst++ = *src++;
+}
+
+/* Copies SIZE bytes from SRC to DST, back to front, for DST
+   following an overlapping SRC.  The word copy runs with the
+   direction flag set; the interrupt entry stubs clear it, so an
+   interrupt in the middle does not see it. */
+static void
+copy_backward (unsigned char *dst, const unsigned char *src, size_t size)
+{
+  dst += size;
+  src += size;
+  if (size >= WORD_MIN)
+    {
+      size_t tail = (uintptr_t) dst & (sizeof (word_t) - 1);
+      size_t words;
+
+      size -= tail;
+      while (tail-- > 0)
+        *--dst = *--src;
+
+      words = size / sizeof (word_t);
+      size %= sizeof (word_t);
+      if (words >= REP_MIN)
+        {
+          dst -= sizeof (word_t);
+          src -= sizeof (word_t);
+          asm volatile ("std; rep movsl; cld"
+                        : "+D" (dst), "+S" (src), "+c" (words) : : "memory");
+          dst += sizeof (word_t);
+          src += sizeof (word_t);
+        }
+      for (; words > 0; words--)
+        {
+          dst -= sizeof (word_t);
+          src -= sizeof (word_t);
+          *(word_t *) dst = *(const word_t *) src;
+        }
+    }
+  while (size-- > 0)
+    *--dst = *--src;
+}
+
 /* Copies SIZE bytes from SRC to DST, which must not overlap.
    Returns DST. */
 void *
@@ -12,9 +105,7 @@ memcpy (void *dst_, const void *src_, size_t size)
   ASSERT (dst != NULL || size == 0);
   ASSERT (src != NULL || size == 0);
 
-  while (size-- > 0)
-    *dst++ = *src++;
-
+  copy_forward (dst, src, size);
   return dst_;
 }
 
@@ -29,20 +120,12 @@ memmove (void *dst_, const void *src_, size_t size)
   ASSERT (dst != NULL || size == 0);
   ASSERT (src != NULL || size == 0);
 
-  if (dst < src) 
-    {
-      while (size-- > 0)
-        *dst++ = *src++;
-    }
-  else 
-    {
-      dst += size;
-      src += size;
-      while (size-- > 0)
-        *--dst = *--src;
-    }
+  if (dst <= src || dst >= src + size)
+    copy_forward (dst, src, size);
+  else
+    copy_backward (dst, src, size);
 
-  return dst;
+  return dst_;
 }
 
 /* Find the first differing byte in the two blocks of SIZE bytes
@@ -58,6 +141,13 @@ memcmp (const void *a_, const void *b_, size_t size)
   ASSERT (a != NULL || size == 0);
   ASSERT (b != NULL || size == 0);
 
+  /* Skip equal words, then find the differing byte. */
+  for (; size >= sizeof (word_t); a += sizeof (word_t), b += sizeof (word_t))
+    {
+      if (*(const word_t *) a != *(const word_t *) b)
+        break;
+      size -= sizeof (word_t);
+    }
   for (; size-- > 0; a++, b++)
     if (*a != *b)
       return *a > *b ? +1 : -1;
@@ -281,7 +371,28 @@ memset (void *dst_, int value, size_t size)
   unsigned char *dst = dst_;
 
   ASSERT (dst != NULL || size == 0);
-  
+
+  if (size >= WORD_MIN)
+    {
+      size_t head = WORD_GAP (dst);
+      uint32_t word = (unsigned char) value * 0x01010101u;
+      size_t words;
+
+      size -= head;
+      while (head-- > 0)
+        *dst++ = value;
+
+      words = size / sizeof (word_t);
+      size %= sizeof (word_t);
+      if (words >= REP_MIN)
+        asm volatile ("rep stosl"
+                      : "+D" (dst), "+c" (words) : "a" (word) : "memory");
+      for (; words > 0; words--)
+        {
+          *(word_t *) dst = word;
+          dst += sizeof (word_t);
+        }
+    }
   while (size-- > 0)
     *dst++ = value;
 
@@ -293,10 +404,19 @@ size_t
 strlen (const char *string) 
 {
   const char *p;
+  const word_t *w;
 
   ASSERT (string != NULL);
 
-  for (p = string; *p != '\0'; p++)
+  /* Check bytes up to a word boundary, then whole words.  An
+     aligned word never straddles a page, so reading past the
+     null terminator within its word cannot fault. */
+  for (p = string; WORD_GAP (p) != 0; p++)
+    if (*p == '\0')
+      return p - string;
+  for (w = (const word_t *) p; !HAS_ZERO_BYTE (*w); w++)
+    continue;
+  for (p = (const char *) w; *p != '\0'; p++)
     continue;
   return p - string;
 }
@@ -0,0 +1,41 @@
+/* Writes a file from three buffers with writev(), reads part of
+   it back with pread(), overwrites its start with pwrite(), and
+   reads the whole file into two buffers with readv().  pread()
+   and pwrite() must not move the file position. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  static char first[] = "Amazing ";
+  static char second[] = "Electronic ";
+  static char third[] = "Fact";
+  struct iovec out[3] = {{first, 8}, {second, 11}, {third, 4}};
+  char head[8], tail[15], buf[10];
+  struct iovec in[2] = {{head, sizeof head}, {tail, sizeof tail}};
+  int handle;
+
+  CHECK (create ("vector", 23), "create \"vector\"");
+  CHECK ((handle = open ("vector")) > 1, "open \"vector\"");
+
+  CHECK (writev (handle, out, 3) == 23, "writev 3 buffers");
+  CHECK (tell (handle) == 23, "tell after writev");
+
+  CHECK (pread (handle, buf, sizeof buf, 8) == sizeof buf, "pread at 8");
+  if (memcmp (buf, "Electronic", sizeof buf))
+    fail ("pread read the wrong bytes");
+  CHECK (pwrite (handle, "Amusing", 7, 0) == 7, "pwrite at 0");
+  CHECK (tell (handle) == 23, "tell after pread and pwrite");
+
+  seek (handle, 0);
+  CHECK (readv (handle, in, 2) == 23, "readv 2 buffers");
+  if (memcmp (head, "Amusing ", sizeof head)
+      || memcmp (tail, "Electronic Fact", sizeof tail))
+    fail ("readv read the wrong bytes");
+
+  CHECK (pwrite (1, "x", 1, 0) == -1, "pwrite to console fails");
+}
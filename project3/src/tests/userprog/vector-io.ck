@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(vector-io) begin
+(vector-io) create "vector"
+(vector-io) open "vector"
+(vector-io) writev 3 buffers
+(vector-io) tell after writev
+(vector-io) pread at 8
+(vector-io) pwrite at 0
+(vector-io) tell after pread and pwrite
+(vector-io) readv 2 buffers
+(vector-io) pwrite to console fails
+(vector-io) end
+vector-io: exit(0)
+EOF
+pass;
@@ -21,10 +21,12 @@
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
+#include "userprog/exec-cache.h"
 #include "userprog/gdt.h"
 #include "userprog/syscall.h"
 #include "userprog/tss.h"
@@ -38,6 +40,9 @@
 #include "filesys/fsutil.h"
 #include "vm/swap.h"
 #endif
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /* Page directory with kernel mappings only. */
 uint32_t *init_page_dir;
@@ -114,6 +119,7 @@ main (void)
 #ifdef USERPROG
   exception_init ();
   syscall_init ();
+  exec_cache_init ();
 #endif
 
   /* Start thread scheduler and enable interrupts. */
@@ -124,7 +130,7 @@ main (void)
   /* Initialize frame tables. */
 #ifdef VM
   hash_init(&frame_table, frame_hash, frame_less, NULL);
-  lock_init (&ft_lock);
+  fast_lock_init (&ft_lock, "ft_lock");
 #endif
 
 #ifdef FILESYS
@@ -263,9 +269,17 @@ parse_options (char **argv)
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-lockstat"))
+        lockstat_enabled = true;
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-fa"))
+        fault_around_pages = atoi (value);
+      else if (!strcmp (name, "-sg"))
+        stack_growth_pages = atoi (value);
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -386,8 +400,13 @@ usage (void)
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -lockstat          Print lock contention statistics at power off.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+          "  -fa=COUNT          Map up to COUNT extra pages per file fault.\n"
+          "  -sg=COUNT          Reserve COUNT stack pages at and below a growth fault.\n"
 #endif
           );
   shutdown_power_off ();
@@ -27,8 +27,10 @@
 */
 
 #include "threads/synch.h"
+#include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 
@@ -157,6 +159,87 @@ sema_test_helper (void *sema_)
     }
 }
 
+/* If true, record lock statistics. */
+bool lockstat_enabled;
+
+/* Statistics for each lock_init() call site.  Locks embedded in
+   objects that come and go (inodes, files) share one entry, so
+   the table never points into freed memory. */
+#define LOCK_STAT_CNT 64
+static struct lock_stat lock_stats[LOCK_STAT_CNT];
+static size_t lock_stat_cnt;
+
+/* Returns the statistics entry for locks named NAME, creating it
+   if necessary, or a null pointer if the table is full. */
+static struct lock_stat *
+lock_stat_lookup (const char *name)
+{
+  struct lock_stat *st = NULL;
+  enum intr_level old_level;
+  size_t i;
+
+  old_level = intr_disable ();
+  for (i = 0; i < lock_stat_cnt; i++)
+    if (!strcmp (lock_stats[i].name, name))
+      {
+        st = &lock_stats[i];
+        break;
+      }
+  if (st == NULL && lock_stat_cnt < LOCK_STAT_CNT)
+    {
+      st = &lock_stats[lock_stat_cnt++];
+      st->name = name;
+    }
+  intr_set_level (old_level);
+  return st;
+}
+
+/* Records in ST that the current thread acquired a lock after
+   waiting from tick START, CONTENDED telling whether it had to
+   block, and stores the current tick in *ACQUIRE_TIME. */
+static void
+lock_stat_acquired (struct lock_stat *st, int64_t *acquire_time,
+                    bool contended, int64_t start)
+{
+  enum intr_level old_level;
+  int64_t now;
+
+  if (st == NULL)
+    return;
+  now = timer_ticks ();
+  *acquire_time = now;
+
+  old_level = intr_disable ();
+  st->acquire_cnt++;
+  if (contended)
+    {
+      int64_t wait = now - start;
+      st->contend_cnt++;
+      st->total_wait += wait;
+      if (wait > st->max_wait)
+        st->max_wait = wait;
+    }
+  intr_set_level (old_level);
+}
+
+/* Records in ST that a lock acquired at tick ACQUIRE_TIME is
+   about to be released. */
+static void
+lock_stat_released (struct lock_stat *st, int64_t acquire_time)
+{
+  enum intr_level old_level;
+  int64_t hold;
+
+  if (st == NULL)
+    return;
+  hold = timer_ticks () - acquire_time;
+
+  old_level = intr_disable ();
+  if (hold > st->max_hold)
+    st->max_hold = hold;
+  intr_set_level (old_level);
+}
+
 /* Initializes LOCK.  A lock can be held by at most a single
    thread at any given time.  Our locks are not "recursive", that
    is, it is an error for the thread currently holding a lock to
@@ -171,14 +254,21 @@ sema_test_helper (void *sema_)
    another one "up" it, but with a lock the same thread must both
    acquire and release it.  When these restrictions prove
    onerous, it's a good sign that a semaphore should be used,
-   instead of a lock. */
+   instead of a lock.
+
+   NAME groups the lock with others of the same name in the
+   -lockstat table; the lock_init() macro passes the "FILE:LINE"
+   of its call site. */
 void
-lock_init (struct lock *lock)
+lock_init_named (struct lock *lock, const char *name)
 {
   ASSERT (lock != NULL);
+  ASSERT (name != NULL);
 
   lock->holder = NULL;
   sema_init (&lock->semaphore, 1);
+  lock->stat = lockstat_enabled ? lock_stat_lookup (name) : NULL;
+  lock->acquire_time = 0;
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
@@ -196,7 +286,15 @@ lock_acquire (struct lock *lock)
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
 
-  sema_down (&lock->semaphore);
+  if (lock->stat != NULL)
+    {
+      int64_t start = timer_ticks ();
+      bool contended = lock->semaphore.value == 0;
+      sema_down (&lock->semaphore);
+      lock_stat_acquired (lock->stat, &lock->acquire_time, contended, start);
+    }
+  else
+    sema_down (&lock->semaphore);
   lock->holder = thread_current ();
 }
 
@@ -216,7 +314,10 @@ lock_try_acquire (struct lock *lock)
 
   success = sema_try_down (&lock->semaphore);
   if (success)
-    lock->holder = thread_current ();
+    {
+      lock->holder = thread_current ();
+      lock_stat_acquired (lock->stat, &lock->acquire_time, false, 0);
+    }
   return success;
 }
 
@@ -231,6 +332,7 @@ lock_release (struct lock *lock)
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
+  lock_stat_released (lock->stat, lock->acquire_time);
   lock->holder = NULL;
   sema_up (&lock->semaphore);
 }
@@ -245,6 +347,42 @@ lock_held_by_current_thread (const struct lock *lock)
 
   return lock->holder == thread_current ();
 }
+
+/* Prints the lock statistics table, worst total wait first.
+   Does nothing unless -lockstat was given. */
+void
+lock_print_stats (void)
+{
+  struct lock_stat *sorted[LOCK_STAT_CNT];
+  size_t i, j;
+
+  if (!lockstat_enabled)
+    return;
+
+  for (i = 0; i < lock_stat_cnt; i++)
+    {
+      struct lock_stat *st = &lock_stats[i];
+      for (j = i; j > 0 && (sorted[j - 1]->total_wait < st->total_wait
+                            || (sorted[j - 1]->total_wait == st->total_wait
+                                && sorted[j - 1]->contend_cnt < st->contend_cnt));
+           j--)
+        sorted[j] = sorted[j - 1];
+      sorted[j] = st;
+    }
+
+  printf ("Locks: %-26s %10s %10s %8s %10s %8s\n", "(ticks)",
+          "acquired", "contended", "max wait", "total wait", "max hold");
+  for (i = 0; i < lock_stat_cnt; i++)
+    {
+      struct lock_stat *st = sorted[i];
+      const char *name = st->name;
+      while (name[0] == '.' && name[1] == '.' && name[2] == '/')
+        name += 3;
+      printf ("       %-26.26s %10llu %10llu %8"PRId64" %10"PRId64" %8"PRId64"\n",
+              name, st->acquire_cnt, st->contend_cnt, st->max_wait,
+              st->total_wait, st->max_hold);
+    }
+}
 
 /* One semaphore in a list. */
 struct semaphore_elem 
@@ -336,3 +474,115 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   while (!list_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
+
+/* Number of times a contended acquirer yields to a preempted
+   holder before blocking.  On a uniprocessor the holder cannot
+   make progress while we spin, so yielding is the nearest thing
+   to spinning: a holder that was preempted inside its critical
+   section usually finishes it within one time slice. */
+#define FAST_LOCK_YIELDS 1
+
+/* Atomically stores 1 in *P and returns its previous value. */
+static inline int
+test_and_set (int *p)
+{
+  int old = 1;
+  asm volatile ("xchgl %0, %1" : "+r" (old), "+m" (*p) : : "memory");
+  return old;
+}
+
+/* Initializes LOCK.  NAME is its row in the -lockstat table,
+   which it shares with ordinary locks. */
+void
+fast_lock_init (struct fast_lock *lock, const char *name)
+{
+  ASSERT (lock != NULL);
+  ASSERT (name != NULL);
+
+  lock->locked = 0;
+  lock->holder = NULL;
+  list_init (&lock->waiters);
+  lock->stat = lockstat_enabled ? lock_stat_lookup (name) : NULL;
+  lock->acquire_time = 0;
+}
+
+/* Acquires LOCK, sleeping until it becomes available if
+   necessary.  The lock must not already be held by the current
+   thread.  Same calling rules as lock_acquire(). */
+void
+fast_lock_acquire (struct fast_lock *lock)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  int64_t start;
+  int yields = 0;
+
+  ASSERT (lock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (lock->holder != cur);
+
+  if (test_and_set (&lock->locked) == 0)
+    {
+      lock->holder = cur;
+      lock_stat_acquired (lock->stat, &lock->acquire_time, false, 0);
+      return;
+    }
+
+  /* Contended.  With interrupts off the holder cannot release
+     between our failed exchange and our going to sleep. */
+  old_level = intr_disable ();
+  start = timer_ticks ();
+  while (test_and_set (&lock->locked) != 0)
+    {
+      struct thread *holder = lock->holder;
+      if (holder != NULL && holder->status == THREAD_READY
+          && yields++ < FAST_LOCK_YIELDS)
+        thread_yield ();
+      else
+        {
+          list_push_back (&lock->waiters, &cur->elem);
+          thread_block ();
+        }
+    }
+  lock->holder = cur;
+  lock_stat_acquired (lock->stat, &lock->acquire_time, true, start);
+  intr_set_level (old_level);
+}
+
+/* Releases LOCK, which must be owned by the current thread, and
+   wakes one waiter if there are any.  The woken thread competes
+   for the lock again, so a running thread may take it first. */
+void
+fast_lock_release (struct fast_lock *lock)
+{
+  ASSERT (lock != NULL);
+  ASSERT (fast_lock_held_by_current_thread (lock));
+
+  lock_stat_released (lock->stat, lock->acquire_time);
+  lock->holder = NULL;
+  barrier ();
+  lock->locked = 0;
+  barrier ();
+
+  /* A waiter queues itself with interrupts off right after its
+     exchange fails, so it is already on the list if it saw the
+     lock held. */
+  if (!list_empty (&lock->waiters))
+    {
+      enum intr_level old_level = intr_disable ();
+      if (!list_empty (&lock->waiters))
+        thread_unblock (list_entry (list_pop_front (&lock->waiters),
+                                    struct thread, elem));
+      intr_set_level (old_level);
+    }
+}
+
+/* Returns true if the current thread holds LOCK, false
+   otherwise. */
+bool
+fast_lock_held_by_current_thread (const struct fast_lock *lock)
+{
+  ASSERT (lock != NULL);
+
+  return lock->holder == thread_current ();
+}
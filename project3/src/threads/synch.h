@@ -3,6 +3,7 @@
 
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 /* A counting semaphore. */
 struct semaphore 
@@ -17,18 +18,44 @@ bool sema_try_down (struct semaphore *);
 void sema_up (struct semaphore *);
 void sema_self_test (void);
 
+/* Contention statistics shared by every lock initialized at one
+   lock_init() call site, or by fast locks given the same name.
+   Collected only under -lockstat. */
+struct lock_stat
+  {
+    const char *name;           /* "FILE:LINE" or fast lock name. */
+    unsigned long long acquire_cnt;   /* Acquisitions. */
+    unsigned long long contend_cnt;   /* Acquisitions that had to wait. */
+    int64_t total_wait;         /* Ticks spent waiting, in total. */
+    int64_t max_wait;           /* Longest single wait, in ticks. */
+    int64_t max_hold;           /* Longest single hold, in ticks. */
+  };
+
+/* If true, record lock statistics.  Set by kernel command-line
+   option "-lockstat". */
+extern bool lockstat_enabled;
+
 /* Lock. */
 struct lock 
   {
     struct thread *holder;      /* Thread holding lock (for debugging). */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
+    struct lock_stat *stat;     /* Statistics, if -lockstat was given. */
+    int64_t acquire_time;       /* Tick at which holder acquired it. */
   };
 
-void lock_init (struct lock *);
+/* String literal "FILE:LINE" for the place it is expanded. */
+#define LOCK_SITE_STR(LINE) #LINE
+#define LOCK_SITE_LINE(LINE) LOCK_SITE_STR (LINE)
+#define LOCK_SITE __FILE__ ":" LOCK_SITE_LINE (__LINE__)
+
+void lock_init_named (struct lock *, const char *name);
+#define lock_init(LOCK) lock_init_named (LOCK, LOCK_SITE)
 void lock_acquire (struct lock *);
 bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
+void lock_print_stats (void);
 
 /* Condition variable. */
 struct condition 
@@ -41,6 +68,24 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Lightweight lock for short critical sections.  An uncontended
+   acquire or release is a single atomic exchange and does not
+   touch the interrupt level or the waiter list; contended
+   acquirers block like they would on a lock. */
+struct fast_lock
+  {
+    int locked;                 /* Nonzero while held. */
+    struct thread *holder;      /* Thread holding lock. */
+    struct list waiters;        /* Threads blocked on the lock. */
+    struct lock_stat *stat;     /* Statistics, if -lockstat was given. */
+    int64_t acquire_time;       /* Tick at which holder acquired it. */
+  };
+
+void fast_lock_init (struct fast_lock *, const char *name);
+void fast_lock_acquire (struct fast_lock *);
+void fast_lock_release (struct fast_lock *);
+bool fast_lock_held_by_current_thread (const struct fast_lock *);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
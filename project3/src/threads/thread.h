@@ -91,6 +91,7 @@ struct thread
 	uint8_t *stack;                     /* Saved stack pointer. */
 	int priority;                       /* Priority. */
 	struct list_elem allelem;           /* List element for all threads list. */
+	struct list_elem tidelem;           /* List element for tid table. */
 
 	/* Shared between thread.c and synch.c. */
 	struct list_elem elem;              /* List element. */
@@ -104,8 +105,7 @@ struct thread
 	unsigned magic;                     /* Detects stack overflow. */
 
 	// Needed for file system sys calls
-	struct list opened_file_list;       /* Keeps track of files opened by a thread. */
-	int fd;                             /* File descriptor */
+	struct fd_table *fd_table;          /* Files opened by a thread, by fd. */
 
 	// Needed for wait/exec sys calls
 	struct list child_list;             /* Keeps track of child processes of a thread */
@@ -117,7 +117,7 @@ struct thread
 	 	 	 	 	 	 	 	 	 	 releasing lock before a condition wait or signal is processed */
 
 	// Needed for Virtual Memory Implementation
-	struct hash page_table;            /* Supplemental page table.	*/
+	struct page_table *page_table;     /* Supplemental page table.	*/
 	struct list mmap_list;             /* List of memory mapped files. */
 	int map_id;                        /* Identifier for memory mapped files. */
 
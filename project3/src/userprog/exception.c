@@ -11,6 +11,12 @@
 /* Number of page faults processed. */
 static long long page_fault_cnt;
 
+/* Number of extra pages mapped by fault-around. */
+static long long fault_around_cnt;
+
+/* Number of page faults that grew the stack. */
+static long long stack_growth_cnt;
+
 static void kill (struct intr_frame *);
 static void page_fault (struct intr_frame *);
 
@@ -68,6 +74,10 @@ void
 exception_print_stats (void) 
 {
 	printf ("Exception: %lld page faults\n", page_fault_cnt);
+	printf ("Exception: %lld pages mapped by fault-around (window %zu)\n",
+			fault_around_cnt, fault_around_pages);
+	printf ("Exception: %lld stack growth faults (window %zu pages)\n",
+			stack_growth_cnt, stack_growth_pages);
 }
 
 /* Handler for an exception (probably) caused by a user process. */
@@ -160,18 +170,24 @@ page_fault (struct intr_frame *f)
 			&& is_user_vaddr (fault_addr)) {
 		struct page_entry *pte = get_page_entry (fault_addr);
 		if (pte) {
-			if (!pte->is_loaded) {
-				if (pte->type == PAGE_FILE) {
-					is_loaded = load_file(pte);
-				} else if (pte->type == PAGE_SWAP) {
-					is_loaded = load_swap(pte);
-				} else if (pte->type == PAGE_MMAP) {
-					is_loaded = load_mmap(pte);
+			// Reserved stack pages obey the same heuristic as stack growth.
+			// A kernel fault has no user esp in F; the syscall layer
+			// already checked the address against the real one.
+			if (!pte->is_loaded
+					&& (pte->type != PAGE_ZERO || !user
+							|| fault_addr >= f->esp - 32)) {
+				is_loaded = load_page (pte);
+				// Map the following pages of the same file while we are here.
+				if (is_loaded) {
+					fault_around_cnt += fault_around (pte);
 				}
 			}
 		} // Got heuristic value from documentation.
 		else if (fault_addr >= f->esp - 32) {
 			is_loaded = grow_stack (fault_addr);
+			if (is_loaded) {
+				stack_growth_cnt++;
+			}
 		}
 	}
 	if (is_loaded == false) {
@@ -0,0 +1,218 @@
+#include "userprog/exec-cache.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Number of executables remembered at once. */
+#define EXEC_CACHE_SIZE 4
+
+/* Read-only pages kept per executable. */
+#define EXEC_CACHE_PAGES 8
+
+/* A copy of one read-only page of an executable. */
+struct cached_page {
+	off_t ofs;				// Offset of the page in the file.
+	uint32_t read_bytes;	// Bytes of the page that came from the file.
+	void *kpage;			// Copy of the page, or a null pointer.
+};
+
+struct exec_cache_entry {
+	bool in_use;
+	unsigned long last_use;	// Value of use_clock at the last hit.
+	struct exec_image image;
+	struct cached_page pages[EXEC_CACHE_PAGES];
+};
+
+static struct exec_cache_entry cache[EXEC_CACHE_SIZE];
+static unsigned long use_clock;
+static struct lock exec_cache_lock;
+
+/* Statistics. */
+static long long hit_cnt, miss_cnt, page_hit_cnt, invalidate_cnt;
+
+void
+exec_cache_init (void)
+{
+	lock_init (&exec_cache_lock);
+}
+
+/*
+ * Returns the entry for INUMBER, or a null pointer if there is
+ * none.  The caller must hold exec_cache_lock.
+ */
+static struct exec_cache_entry *
+find_entry (block_sector_t inumber)
+{
+	size_t i;
+
+	for (i = 0; i < EXEC_CACHE_SIZE; i++) {
+		if (cache[i].in_use && cache[i].image.inumber == inumber) {
+			return &cache[i];
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Frees E's page copies and marks it unused.  The caller must
+ * hold exec_cache_lock.
+ */
+static void
+clear_entry (struct exec_cache_entry *e)
+{
+	size_t i;
+
+	for (i = 0; i < EXEC_CACHE_PAGES; i++) {
+		palloc_free_page (e->pages[i].kpage);
+		e->pages[i].kpage = NULL;
+	}
+	e->in_use = false;
+}
+
+/*
+ * Copies the cached image of the executable with inode INUMBER
+ * into IMAGE.  Returns false if it is not cached.
+ */
+bool
+exec_cache_lookup (block_sector_t inumber, struct exec_image *image)
+{
+	struct exec_cache_entry *e;
+
+	lock_acquire (&exec_cache_lock);
+	e = find_entry (inumber);
+	if (e != NULL) {
+		e->last_use = ++use_clock;
+		*image = e->image;
+		hit_cnt++;
+	} else {
+		miss_cnt++;
+	}
+	lock_release (&exec_cache_lock);
+	return e != NULL;
+}
+
+/*
+ * Remembers IMAGE, replacing the least recently used entry if the
+ * cache is full.
+ */
+void
+exec_cache_insert (const struct exec_image *image)
+{
+	struct exec_cache_entry *e;
+	size_t i;
+
+	lock_acquire (&exec_cache_lock);
+	e = find_entry (image->inumber);
+	if (e == NULL) {
+		e = &cache[0];
+		for (i = 0; i < EXEC_CACHE_SIZE && e->in_use; i++) {
+			if (!cache[i].in_use || cache[i].last_use < e->last_use) {
+				e = &cache[i];
+			}
+		}
+		if (e->in_use) {
+			clear_entry (e);
+		}
+	}
+	e->in_use = true;
+	e->last_use = ++use_clock;
+	e->image = *image;
+	lock_release (&exec_cache_lock);
+}
+
+/*
+ * Forgets the executable with inode INUMBER, if it is cached.
+ * Called whenever the inode is written or deleted.
+ */
+void
+exec_cache_invalidate (block_sector_t inumber)
+{
+	struct exec_cache_entry *e;
+
+	lock_acquire (&exec_cache_lock);
+	e = find_entry (inumber);
+	if (e != NULL) {
+		clear_entry (e);
+		invalidate_cnt++;
+	}
+	lock_release (&exec_cache_lock);
+}
+
+/*
+ * If the page at OFS in the executable with inode INUMBER, of
+ * which READ_BYTES come from the file, is cached, copies it into
+ * KPAGE and returns true.  Otherwise returns false.
+ */
+bool
+exec_cache_read_page (block_sector_t inumber, off_t ofs,
+		uint32_t read_bytes, void *kpage)
+{
+	struct exec_cache_entry *e;
+	bool found = false;
+	size_t i;
+
+	lock_acquire (&exec_cache_lock);
+	e = find_entry (inumber);
+	for (i = 0; e != NULL && i < EXEC_CACHE_PAGES; i++) {
+		struct cached_page *p = &e->pages[i];
+		if (p->kpage != NULL && p->ofs == ofs && p->read_bytes == read_bytes) {
+			memcpy (kpage, p->kpage, PGSIZE);
+			page_hit_cnt++;
+			found = true;
+			break;
+		}
+	}
+	lock_release (&exec_cache_lock);
+	return found;
+}
+
+/*
+ * Keeps a copy of KPAGE, the page at OFS in the executable with
+ * inode INUMBER, so that later execs need not read it from disk.
+ * Does nothing if the executable is not cached, if its page slots
+ * are full, or if no kernel page is free.  Only pages that are
+ * mapped read-only may be saved: the copy must match the file.
+ */
+void
+exec_cache_save_page (block_sector_t inumber, off_t ofs,
+		uint32_t read_bytes, const void *kpage)
+{
+	struct exec_cache_entry *e;
+	struct cached_page *slot = NULL;
+	size_t i;
+
+	lock_acquire (&exec_cache_lock);
+	e = find_entry (inumber);
+	for (i = 0; e != NULL && i < EXEC_CACHE_PAGES; i++) {
+		struct cached_page *p = &e->pages[i];
+		if (p->kpage == NULL) {
+			if (slot == NULL) {
+				slot = p;
+			}
+		} else if (p->ofs == ofs && p->read_bytes == read_bytes) {
+			slot = NULL;
+			break;
+		}
+	}
+	if (slot != NULL) {
+		slot->kpage = palloc_get_page (0);
+		if (slot->kpage != NULL) {
+			memcpy (slot->kpage, kpage, PGSIZE);
+			slot->ofs = ofs;
+			slot->read_bytes = read_bytes;
+		}
+	}
+	lock_release (&exec_cache_lock);
+}
+
+/* Prints exec cache statistics. */
+void
+exec_cache_print_stats (void)
+{
+	printf ("Exec cache: %lld hits, %lld misses, %lld page hits, "
+			"%lld invalidations\n",
+			hit_cnt, miss_cnt, page_hit_cnt, invalidate_cnt);
+}
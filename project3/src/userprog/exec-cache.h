@@ -0,0 +1,41 @@
+#ifndef USERPROG_EXEC_CACHE_H
+#define USERPROG_EXEC_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "devices/block.h"
+#include "filesys/off_t.h"
+
+/* Most loadable segments in a cached executable.  Executables
+   with more are loaded without the cache. */
+#define EXEC_SEGMENT_MAX 8
+
+/* A PT_LOAD segment, already validated and rounded to pages. */
+struct exec_segment {
+	off_t ofs;				// Page-aligned offset in the file.
+	uint8_t *upage;			// First user page.
+	uint32_t read_bytes;	// Bytes read from the file.
+	uint32_t zero_bytes;	// Bytes zeroed after READ_BYTES.
+	bool writable;			// Mapped writable?
+};
+
+/* Everything load() learns from an executable's headers. */
+struct exec_image {
+	block_sector_t inumber;		// Inode of the executable.
+	void (*entry) (void);		// Entry point.
+	size_t segment_cnt;			// Number of SEGMENTS in use.
+	struct exec_segment segments[EXEC_SEGMENT_MAX];
+};
+
+void exec_cache_init (void);
+bool exec_cache_lookup (block_sector_t inumber, struct exec_image *image);
+void exec_cache_insert (const struct exec_image *image);
+void exec_cache_invalidate (block_sector_t inumber);
+bool exec_cache_read_page (block_sector_t inumber, off_t ofs,
+		uint32_t read_bytes, void *kpage);
+void exec_cache_save_page (block_sector_t inumber, off_t ofs,
+		uint32_t read_bytes, const void *kpage);
+void exec_cache_print_stats (void);
+
+#endif /* userprog/exec-cache.h */
@@ -9,9 +9,11 @@
 #include "userprog/pagedir.h"
 #include "userprog/tss.h"
 #include "userprog/syscall.h"
+#include "userprog/exec-cache.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
@@ -88,7 +90,7 @@ start_process (void *file_name_)
 	bool success;
 
 	// Initializing a supplemental page table.
-	hash_init (&thread_current ()->page_table, page_hash, page_less, NULL);
+	thread_current ()->page_table = page_table_create ();
 
 	/* Initialize interrupt frame and load executable. */
 	memset (&if_, 0, sizeof if_);
@@ -205,8 +207,15 @@ process_exit (void)
 		}
 	}
 
+	/* Write back dirty mmap pages in disk order, then drop every
+	   frame from the frame table at once.  The frames themselves are
+	   freed along with the page directory below, so tearing down the
+	   page table and the mappings only frees bookkeeping. */
+	write_back_mmap (-1);
+	frame_release_process ();
 	remove_process_mmap(-1);
-	hash_destroy (&cur->page_table, page_destroy_action);
+	page_table_destroy (cur->page_table, page_destroy_action);
+	cur->page_table = NULL;
 
 	/* Destroy the current process's page directory and switch back
      to the kernel-only page directory. */
@@ -312,6 +321,9 @@ struct Elf32_Phdr
 static bool setup_stack (char *file_name, void **esp);
 static bool stack_setup_for_args (char *str_token, char *token_ptr, void **esp);
 static bool validate_segment (const struct Elf32_Phdr *, struct file *);
+static bool read_image (struct file *, const char *file_name,
+		struct exec_image *, bool *cacheable);
+static void prefault_entry (void *entry);
 static bool load_segment (struct file *file, off_t ofs, uint8_t *upage,
 		uint32_t read_bytes, uint32_t zero_bytes,
 		bool writable);
@@ -324,11 +336,10 @@ bool
 load (const char *file_name, void (**eip) (void), void **esp)
 {
 	struct thread *t = thread_current ();
-	struct Elf32_Ehdr ehdr;
+	struct exec_image image;
 	struct file *file = NULL;
-	off_t file_ofs;
 	bool success = false;
-	int i;
+	size_t i;
 	char *fn_copy, *func_name;
 	fn_copy = palloc_get_page (0);
 	if (fn_copy == NULL)
@@ -351,8 +362,69 @@ load (const char *file_name, void (**eip) (void), void **esp)
 		goto done;
 	}
 
+	/* Deny writes before looking at the headers, so that what we
+	   parse (or find cached) cannot change under us.  file_close()
+	   allows writes again if the load fails. */
+	file_deny_write (file);
+
+	/* Parse the headers unless this executable was loaded before.
+	   read_image() loads the segments itself as it finds them. */
+	if (exec_cache_lookup (inode_get_inumber (file_get_inode (file)), &image))
+	{
+		for (i = 0; i < image.segment_cnt; i++)
+		{
+			struct exec_segment *seg = &image.segments[i];
+			if (!load_segment (file, seg->ofs, seg->upage,
+					seg->read_bytes, seg->zero_bytes, seg->writable))
+				goto done;
+		}
+	}
+	else
+	{
+		bool cacheable;
+		if (!read_image (file, file_name, &image, &cacheable))
+			goto done;
+		if (cacheable)
+			exec_cache_insert (&image);
+	}
+
+	/* Set up stack. */
+	if (!setup_stack (fn_copy, esp)) {
+		palloc_free_page (fn_copy);
+		goto done;
+	}
+
+	/* Start address. */
+	*eip = image.entry;
+	prefault_entry (*eip);
+	success = true;
+	palloc_free_page (fn_copy);
+	return success;
+
+	done:
+	/* We arrive here whether the load is successful or not. */
+	file_close (file);
+	return success;
+}
+
+/* Reads and validates the ELF header and program headers of
+   FILE, whose command line is FILE_NAME, loads each loadable
+   segment, and records the entry point and segments in IMAGE.
+   Sets *CACHEABLE to false if there were more segments than
+   IMAGE can hold.  Returns true if successful, false
+   otherwise. */
+static bool
+read_image (struct file *file, const char *file_name,
+		struct exec_image *image, bool *cacheable)
+{
+	struct Elf32_Ehdr ehdr;
+	struct Elf32_Phdr *phdrs = NULL;
+	off_t phdrs_size;
+	bool success = false;
+	int i;
+
 	/* Read and verify executable header. */
-	if (file_read (file, &ehdr, sizeof ehdr) != sizeof ehdr
+	if (file_read_at (file, &ehdr, sizeof ehdr, 0) != sizeof ehdr
 			|| memcmp (ehdr.e_ident, "\177ELF\1\1\1", 7)
 			|| ehdr.e_type != 2
 			|| ehdr.e_machine != 3
@@ -361,22 +433,30 @@ load (const char *file_name, void (**eip) (void), void **esp)
 			|| ehdr.e_phnum > 1024)
 	{
 		printf ("load: %s: error loading executable\n", file_name);
-		goto done;
+		return false;
 	}
 
-	/* Read program headers. */
-	file_ofs = ehdr.e_phoff;
-	for (i = 0; i < ehdr.e_phnum; i++)
+	/* Read all the program headers with a single call instead of
+	   a seek and a read per header. */
+	phdrs_size = ehdr.e_phnum * sizeof *phdrs;
+	if (ehdr.e_phoff > (Elf32_Off) file_length (file))
+		return false;
+	if (phdrs_size > 0)
 	{
-		struct Elf32_Phdr phdr;
-
-		if (file_ofs < 0 || file_ofs > file_length (file))
+		phdrs = malloc (phdrs_size);
+		if (phdrs == NULL
+				|| file_read_at (file, phdrs, phdrs_size, ehdr.e_phoff) != phdrs_size)
 			goto done;
-		file_seek (file, file_ofs);
+	}
+
+	image->inumber = inode_get_inumber (file_get_inode (file));
+	image->entry = (void (*) (void)) ehdr.e_entry;
+	image->segment_cnt = 0;
+	*cacheable = true;
+	for (i = 0; i < ehdr.e_phnum; i++)
+	{
+		struct Elf32_Phdr phdr = phdrs[i];
 
-		if (file_read (file, &phdr, sizeof phdr) != sizeof phdr)
-			goto done;
-		file_ofs += sizeof phdr;
 		switch (phdr.p_type)
 		{
 		case PT_NULL:
@@ -393,52 +473,46 @@ load (const char *file_name, void (**eip) (void), void **esp)
 		case PT_LOAD:
 			if (validate_segment (&phdr, file))
 			{
-				bool writable = (phdr.p_flags & PF_W) != 0;
-				uint32_t file_page = phdr.p_offset & ~PGMASK;
-				uint32_t mem_page = phdr.p_vaddr & ~PGMASK;
+				struct exec_segment seg;
 				uint32_t page_offset = phdr.p_vaddr & PGMASK;
-				uint32_t read_bytes, zero_bytes;
+				seg.writable = (phdr.p_flags & PF_W) != 0;
+				seg.ofs = phdr.p_offset & ~PGMASK;
+				seg.upage = (uint8_t *) (phdr.p_vaddr & ~PGMASK);
 				if (phdr.p_filesz > 0)
 				{
 					/* Normal segment.
                      Read initial part from disk and zero the rest. */
-					read_bytes = page_offset + phdr.p_filesz;
-					zero_bytes = (ROUND_UP (page_offset + phdr.p_memsz, PGSIZE)
-							- read_bytes);
+					seg.read_bytes = page_offset + phdr.p_filesz;
+					seg.zero_bytes = (ROUND_UP (page_offset + phdr.p_memsz, PGSIZE)
+							- seg.read_bytes);
 				}
 				else
 				{
 					/* Entirely zero.
                      Don't read anything from disk. */
-					read_bytes = 0;
-					zero_bytes = ROUND_UP (page_offset + phdr.p_memsz, PGSIZE);
+					seg.read_bytes = 0;
+					seg.zero_bytes = ROUND_UP (page_offset + phdr.p_memsz, PGSIZE);
 				}
-				if (!load_segment (file, file_page, (void *) mem_page,
-						read_bytes, zero_bytes, writable))
+				if (!load_segment (file, seg.ofs, seg.upage,
+						seg.read_bytes, seg.zero_bytes, seg.writable))
 					goto done;
+
+				/* An executable with more segments than fit is
+				   still loaded, just not cached. */
+				if (image->segment_cnt < EXEC_SEGMENT_MAX)
+					image->segments[image->segment_cnt++] = seg;
+				else
+					*cacheable = false;
 			}
 			else
 				goto done;
 			break;
 		}
 	}
-
-	/* Set up stack. */
-	if (!setup_stack (fn_copy, esp)) {
-		palloc_free_page (fn_copy);
-		goto done;
-	}
-
-	/* Start address. */
-	*eip = (void (*) (void)) ehdr.e_entry;
 	success = true;
-	palloc_free_page (fn_copy);
-	file_deny_write (file);
-	return success;
 
 	done:
-	/* We arrive here whether the load is successful or not. */
-	file_close (file);
+	free (phdrs);
 	return success;
 }
 
@@ -509,8 +583,7 @@ static bool insert_file_in_page_table (struct file *file, int32_t ofs, uint8_t *
 		pte->is_loaded = false;
 		pte->is_writable = is_writable;
 		pte->swap_offset = 0;
-		pte->is_pinned = false;
-		return (hash_insert(&cur->page_table, &pte->page_elem) == NULL);
+		return page_table_insert (cur->page_table, pte);
 	} else {
 		return false;
 	}
@@ -548,7 +621,8 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 		size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
 		// we need to add file to page table
-		bool inserted = insert_file_in_page_table (file, ofs, upage, read_bytes, zero_bytes, writable);
+		bool inserted = insert_file_in_page_table (file, ofs, upage,
+				page_read_bytes, page_zero_bytes, writable);
 		if (!inserted) {
 			return false;
 		}
@@ -562,6 +636,20 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 	return true;
 }
 
+/* Maps the page holding ENTRY, plus whatever fault-around would
+   bring in with it, so the first instruction does not fault.
+   The first stack page is already mapped by setup_stack().
+   Failure is harmless: the page is simply faulted in later. */
+static void
+prefault_entry (void *entry)
+{
+	struct page_entry *pte = get_page_entry (pg_round_down (entry));
+
+	if (pte != NULL && !pte->is_loaded && load_page (pte)) {
+		fault_around (pte);
+	}
+}
+
 /* Create a minimal stack by mapping a zeroed page at the top of
    user virtual memory. */
 static bool
@@ -1,30 +1,60 @@
 #include "userprog/syscall.h"
+#include <bitmap.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <round.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <syscall-nr.h>
 #include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "devices/input.h"
 #include "devices/shutdown.h"
+#include "devices/timer.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "userprog/pagedir.h"
 #include "userprog/process.h"
 #include "vm/frame.h"
 #include "vm/page.h"
 
-// Lock required for file related syscalls
+// Serializes syscalls that change the file system namespace
+// (create, remove, open, close).  Reads, writes and seeks rely on
+// the per-file position lock and the per-inode write lock instead.
 struct lock file_lock;
 
+/* Most buffers one readv or writev call may name.  Must
+   match IOV_MAX in lib/user/syscall.h. */
+#define IOV_MAX 32
+
+/* Pages in the kernel buffer that readv, writev, pread and
+   pwrite stage data in, so that one file system call covers
+   many user buffers and many sectors. */
+#define VECTOR_IO_PAGES 8
+
+/* One buffer of a readv or writev call, laid out like struct
+   iovec in lib/user/syscall.h.  IOV_BASE is a user address. */
+struct iovec
+{
+	void *iov_base;
+	size_t iov_len;
+};
+
 static void syscall_handler (struct intr_frame *);
 static struct page_entry *check_ptr_validity (const void *vaddr, void *esp);
 static struct page_entry *check_valid_pte (const void *vaddr, void *esp);
 static void check_buffer_validity (void* buffer, unsigned size, void *esp, bool to_write);
-static void extract_args (struct intr_frame *f, int numargs, int *args);
+static void check_user_block (const void *uaddr, size_t size, void *esp);
 static bool insert_mmap_in_page_table(struct file *file, int32_t ofs, uint8_t *upage,
 		uint32_t read_bytes, uint32_t zero_bytes, bool writable);
 static bool add_process_mmap (struct page_entry *pte);
+static int vector_io (int fd, const struct iovec *iov, int iovcnt, off_t ofs,
+		bool is_read, void *esp);
 
 void
 syscall_init (void)
@@ -43,14 +73,9 @@ static struct page_entry
 	bool load = false;
 	struct page_entry *pte = get_page_entry (vaddr);
 	if (pte) {
-		if (!pte->is_loaded) {
-			if (pte->type == PAGE_FILE) {
-				load_file(pte);
-			} else if (pte->type == PAGE_SWAP) {
-				load_swap(pte);
-			} else if (pte->type == PAGE_MMAP) {
-				load_mmap(pte);
-			}
+		if (!pte->is_loaded
+				&& (pte->type != PAGE_ZERO || esp - 32 < vaddr)) {
+			load_page (pte);
 		}
 
 		load = pte->is_loaded;
@@ -65,36 +90,142 @@ static struct page_entry
 /*
  * Used for read/write syscalls to check memory
  * pointer validity of the buffer to read/write.
+ * Each page spanned by the buffer is validated
+ * once.  Nothing is pinned here: the transfer
+ * pins one page at a time, so a buffer larger
+ * than the user pool still leaves frames to
+ * evict.
  */
 static void
 check_buffer_validity (void* buffer, unsigned size, void *esp, bool to_write)
 {
-	unsigned i;
-	char *temp_buffer = (char *) buffer;
-	for (i=0; i<size; i++) {
-		struct page_entry *pte =
-				check_ptr_validity ((const void*) temp_buffer, esp);
+	uint8_t *start = buffer;
+	uint8_t *last = start + size - 1;
+	uint8_t *upage;
+
+	if (size == 0) {
+		return;
+	}
+	if (last < start) {
+		exit (-1);
+	}
+
+	for (upage = pg_round_down (start);
+			upage <= (uint8_t *) pg_round_down (last);
+			upage += PGSIZE) {
+		const void *vaddr = upage < start ? start : upage;
+		struct page_entry *pte = check_ptr_validity (vaddr, esp);
+		if (pte == NULL) {
+			// The page was just created by stack growth.
+			pte = get_page_entry ((void *) vaddr);
+		}
 		if (to_write && pte) {
 			if (pte->is_writable == false) {
 				exit (-1);
 			}
 		}
-		temp_buffer++;
 	}
 }
 
+/*
+ * Copies SIZE bytes from the kernel buffer KBUF to user
+ * address UBUF, or from UBUF into KBUF if TO_USER is false.
+ * UBUF is checked, then each of its pages is brought in and
+ * pinned only while it is copied.  Exits with -1 status if
+ * UBUF is not valid.  Returns false if a page cannot be
+ * pinned, true otherwise.
+ */
+static bool
+copy_user (void *ubuf, void *kbuf, size_t size, bool to_user, void *esp)
+{
+	struct thread *cur = thread_current ();
+	uint8_t *u = ubuf;
+	uint8_t *k = kbuf;
+
+	check_buffer_validity (ubuf, size, esp, to_user);
+	while (size > 0) {
+		size_t chunk = PGSIZE - pg_ofs (u);
+		uint8_t *kaddr = frame_pin_user_page (u);
+		if (kaddr == NULL) {
+			return false;
+		}
+		if (chunk > size) {
+			chunk = size;
+		}
+		if (to_user) {
+			memcpy (kaddr, k, chunk);
+			pagedir_set_dirty (cur->pagedir, u, true);
+		} else {
+			memcpy (k, kaddr, chunk);
+		}
+		frame_unpin (kaddr);
+		u += chunk;
+		k += chunk;
+		size -= chunk;
+	}
+	return true;
+}
+
+/*
+ * Moves SIZE bytes between FILE and the user buffer UBUF one
+ * page-sized chunk at a time.  Each page is brought in and
+ * pinned, transferred through its frame's kernel address, and
+ * unpinned before the next, so at most one page of the buffer
+ * is ever pinned and a buffer larger than the user pool cannot
+ * leave eviction without a victim.  Nothing is staged in a
+ * kernel buffer.  Stops early on a short read or write.
+ * Returns the bytes moved, or -1 if the first page could not
+ * be pinned.
+ */
+static int
+transfer_pinned (struct file *file, uint8_t *ubuf, unsigned size, bool is_read)
+{
+	struct thread *cur = thread_current ();
+	int total = 0;
+
+	while (size > 0) {
+		unsigned chunk = PGSIZE - pg_ofs (ubuf);
+		if (chunk > size) {
+			chunk = size;
+		}
+
+		void *kaddr = frame_pin_user_page (ubuf);
+		if (kaddr == NULL) {
+			return total > 0 ? total : -1;
+		}
+		off_t done = is_read ? file_read (file, kaddr, chunk)
+				: file_write (file, kaddr, chunk);
+		if (is_read && done > 0) {
+			// The write went through the kernel alias, which does
+			// not set the user mapping's dirty bit.
+			pagedir_set_dirty (cur->pagedir, ubuf, true);
+		}
+		frame_unpin (kaddr);
+
+		total += done;
+		if (done < (off_t) chunk) {
+			break;
+		}
+		ubuf += chunk;
+		size -= chunk;
+	}
+	return total;
+}
+
 /*
  * Checks validity of address of each character
- * position in the string str.
+ * position in the string str.  The page table
+ * is consulted once per page the string spans.
  */
 void check_str_validity (const void* str, void *esp)
 {
 	check_ptr_validity(str, esp);
-	//TODO: refactor if poss
 	while (*(char *) str != 0)
 	{
 		str = (char *) str + 1;
-		check_ptr_validity(str, esp);
+		if (pg_ofs (str) == 0) {
+			check_ptr_validity(str, esp);
+		}
 	}
 }
 
@@ -117,114 +248,261 @@ static struct page_entry
 }
 
 /*
- * Extract numargs args from stack and save
- * them in *args.
+ * Checks that the SIZE bytes at user address UADDR, which
+ * may span at most two pages, are valid and resident,
+ * bringing pages in as needed.  Exits with -1 status if
+ * not.
  */
 static void
-extract_args (struct intr_frame *f, int numargs, int *args)
+check_user_block (const void *uaddr, size_t size, void *esp)
 {
-	int i;
-	int *ptr;
-	for (i=1; i<=numargs; i++)
-	{
-		ptr = ((int *) f->esp) + i;
-		check_ptr_validity(ptr, f->esp);
-		args[i-1] = *ptr;
+	const uint8_t *start = uaddr;
+	const uint8_t *last = start + size - 1;
+
+	ASSERT (size > 0 && size <= PGSIZE);
+	if (last < start || !is_user_vaddr (last)) {
+		exit (-1);
+	}
+	check_ptr_validity (start, esp);
+	if (pg_no (last) != pg_no (start)) {
+		check_ptr_validity (last, esp);
+	}
+}
+
+/* System call wrappers.  Each takes the argument words
+   copied from the user stack and the user stack pointer,
+   checks any pointers among the arguments, and returns
+   the value for eax. */
+
+static int
+sys_halt (const int *args UNUSED, void *esp UNUSED)
+{
+	halt ();
+	return 0;
+}
+
+static int
+sys_exit (const int *args, void *esp UNUSED)
+{
+	exit (args[0]);
+	return 0;
+}
+
+static int
+sys_exec (const int *args, void *esp)
+{
+	check_str_validity ((const void *) args[0], esp);
+	return exec ((const char *) args[0]);
+}
+
+static int
+sys_wait (const int *args, void *esp UNUSED)
+{
+	return wait ((pid_t) args[0]);
+}
+
+static int
+sys_create (const int *args, void *esp)
+{
+	check_str_validity ((const void *) args[0], esp);
+	return create ((const char *) args[0], (unsigned) args[1]);
+}
+
+static int
+sys_remove (const int *args, void *esp)
+{
+	check_str_validity ((const void *) args[0], esp);
+	return remove ((const char *) args[0]);
+}
+
+static int
+sys_open (const int *args, void *esp)
+{
+	check_str_validity ((const void *) args[0], esp);
+	return open ((const char *) args[0]);
+}
+
+static int
+sys_filesize (const int *args, void *esp UNUSED)
+{
+	return filesize (args[0]);
+}
+
+static int
+sys_read (const int *args, void *esp)
+{
+	check_buffer_validity ((void *) args[1], (unsigned) args[2], esp, true);
+	return read (args[0], (void *) args[1], (unsigned) args[2]);
+}
+
+static int
+sys_write (const int *args, void *esp)
+{
+	check_buffer_validity ((void *) args[1], (unsigned) args[2], esp, false);
+	return write (args[0], (void *) args[1], (unsigned) args[2]);
+}
+
+static int
+sys_seek (const int *args, void *esp UNUSED)
+{
+	seek (args[0], (unsigned) args[1]);
+	return 0;
+}
+
+static int
+sys_tell (const int *args, void *esp UNUSED)
+{
+	return tell (args[0]);
+}
+
+static int
+sys_close (const int *args, void *esp UNUSED)
+{
+	close (args[0]);
+	return 0;
+}
+
+static int
+sys_mmap (const int *args, void *esp UNUSED)
+{
+	return mmap (args[0], (void *) args[1]);
+}
+
+static int
+sys_munmap (const int *args, void *esp UNUSED)
+{
+	munmap (args[0]);
+	return 0;
+}
+
+/*
+ * Copies the IOVCNT iovecs at user address UIOV into IOV.
+ * Returns false if IOVCNT is out of range or the array
+ * cannot be brought in.
+ */
+static bool
+copy_in_iov (struct iovec *iov, const void *uiov, int iovcnt, void *esp)
+{
+	size_t size = iovcnt * sizeof *iov;
+
+	if (iovcnt < 0 || iovcnt > IOV_MAX) {
+		return false;
+	}
+	return copy_user ((void *) uiov, iov, size, false, esp);
+}
+
+static int
+sys_readv (const int *args, void *esp)
+{
+	struct iovec iov[IOV_MAX];
+
+	if (!copy_in_iov (iov, (const void *) args[1], args[2], esp)) {
+		return -1;
+	}
+	return vector_io (args[0], iov, args[2], -1, true, esp);
+}
+
+static int
+sys_writev (const int *args, void *esp)
+{
+	struct iovec iov[IOV_MAX];
+
+	if (!copy_in_iov (iov, (const void *) args[1], args[2], esp)) {
+		return -1;
 	}
+	return vector_io (args[0], iov, args[2], -1, false, esp);
 }
 
+static int
+sys_pread (const int *args, void *esp)
+{
+	struct iovec iov = {(void *) args[1], (unsigned) args[2]};
+
+	if (args[3] < 0) {
+		return -1;
+	}
+	return vector_io (args[0], &iov, 1, args[3], true, esp);
+}
+
+static int
+sys_pwrite (const int *args, void *esp)
+{
+	struct iovec iov = {(void *) args[1], (unsigned) args[2]};
+
+	if (args[3] < 0) {
+		return -1;
+	}
+	return vector_io (args[0], &iov, 1, args[3], false, esp);
+}
+
+/* Most argument words any system call takes. */
+#define SYSCALL_MAX_ARGS 4
+
+/* A system call as seen by the dispatcher. */
+struct syscall_entry
+{
+	int arg_cnt;								// Argument words on the user stack.
+	int (*func) (const int *args, void *esp);	// Wrapper that carries it out.
+};
+
+/*
+ * Dispatch table, indexed by system call number.  Numbers
+ * without an entry kill the process.
+ */
+static const struct syscall_entry syscall_table[] =
+{
+	[SYS_HALT] = {0, sys_halt},
+	[SYS_EXIT] = {1, sys_exit},
+	[SYS_EXEC] = {1, sys_exec},
+	[SYS_WAIT] = {1, sys_wait},
+	[SYS_CREATE] = {2, sys_create},
+	[SYS_REMOVE] = {1, sys_remove},
+	[SYS_OPEN] = {1, sys_open},
+	[SYS_FILESIZE] = {1, sys_filesize},
+	[SYS_READ] = {3, sys_read},
+	[SYS_WRITE] = {3, sys_write},
+	[SYS_SEEK] = {2, sys_seek},
+	[SYS_TELL] = {1, sys_tell},
+	[SYS_CLOSE] = {1, sys_close},
+	[SYS_MMAP] = {2, sys_mmap},
+	[SYS_MUNMAP] = {1, sys_munmap},
+	[SYS_READV] = {3, sys_readv},
+	[SYS_WRITEV] = {3, sys_writev},
+	[SYS_PREAD] = {4, sys_pread},
+	[SYS_PWRITE] = {4, sys_pwrite},
+};
+
+/*
+ * Validates the call number and its arguments on the user
+ * stack as one block, copies the arguments out, and calls
+ * the wrapper from syscall_table.  The number's page is
+ * looked up once; the next page is only looked up if the
+ * arguments run onto it.
+ */
 static void
-syscall_handler (struct intr_frame *f UNUSED)
-{
-	int args[3];
-	check_ptr_validity ((const void*) f->esp, f->esp);
-	int *esp_pointer = (int *) f->esp;
-
-	switch (*esp_pointer) {
-	case SYS_HALT:
-		halt ();
-		break;
-
-	case SYS_EXIT:
-		extract_args (f, 1, &args[0]);
-		exit (args[0]);
-		break;
-
-	case SYS_EXEC:
-		extract_args (f, 1, &args[0]);
-		check_str_validity ((const void*) args[0], f->esp);
-		f->eax = exec ((const char*) args[0]);
-		break;
-
-	case SYS_WAIT:
-		extract_args (f, 1, &args[0]);
-		f->eax = wait ((pid_t) args[0]);
-		break;
-
-	case SYS_CREATE:
-		extract_args (f, 2, &args[0]);
-		check_str_validity ((const void*) args[0], f->esp);
-		f->eax = create ((const char*) args[0], (unsigned) args[1]);
-		break;
-
-	case SYS_REMOVE:
-		extract_args (f, 1, &args[0]);
-		check_str_validity ((const void*) args[0], f->esp);
-		f->eax = remove ((const char*) args[0]);
-		break;
-
-	case SYS_OPEN:
-		extract_args (f, 1, &args[0]);
-		check_str_validity ((const void*) args[0], f->esp);
-		f->eax = open ((const char*) args[0]);
-		break;
-
-	case SYS_FILESIZE:
-		extract_args (f, 1, &args[0]);
-		f->eax = filesize (args[0]);
-		break;
-
-	case SYS_READ:
-		extract_args (f, 3, &args[0]);
-		check_buffer_validity ((void *) args[1], (unsigned) args[2], f->esp, true);
-		f->eax = read ((int) args[0], (void *) args[1], (unsigned) args[2]);
-		break;
-
-	case SYS_WRITE:
-		extract_args (f, 3, &args[0]);
-		check_buffer_validity ((void *) args[1], (unsigned) args[2], f->esp, false);
-		f->eax = write ((int) args[0], (void *) args[1], (unsigned) args[2]);
-		break;
-
-	case SYS_SEEK:
-		extract_args (f, 2, &args[0]);
-		seek ((int) args[0], (unsigned) args[1]);
-		break;
-
-	case SYS_TELL:
-		extract_args (f, 1, &args[0]);
-		f->eax = tell ((int) args[0]);
-		break;
-
-	case SYS_CLOSE:
-		extract_args (f, 1, &args[0]);
-		close ((int) args[0]);
-		break;
-
-	case SYS_MMAP:
-		extract_args (f, 2, &args[0]);
-		f->eax = mmap (args[0], (void *) args[1]);
-		break;
-
-	case SYS_MUNMAP:
-		extract_args (f, 1, &args[0]);
-		munmap (args[0]);
-		break;
-
-	default:
+syscall_handler (struct intr_frame *f)
+{
+	const int *esp = f->esp;
+	const struct syscall_entry *sc;
+	const uint8_t *last;
+	int args[SYSCALL_MAX_ARGS];
+	unsigned nr;
+
+	check_user_block (esp, sizeof *esp, f->esp);
+	nr = *esp;
+	if (nr >= sizeof syscall_table / sizeof *syscall_table
+			|| syscall_table[nr].func == NULL) {
 		exit (-1);
-		break;
 	}
+	sc = &syscall_table[nr];
+
+	last = (const uint8_t *) (esp + 1 + sc->arg_cnt) - 1;
+	if (pg_no (last) != pg_no ((const uint8_t *) (esp + 1) - 1)) {
+		check_user_block (last, 1, f->esp);
+	}
+	memcpy (args, esp + 1, sc->arg_cnt * sizeof *esp);
+
+	f->eax = sc->func (args, f->esp);
 }
 
 void
@@ -251,9 +529,15 @@ exit (int status)
 	thread_exit ();
 }
 
+/* Number of successful exec() calls, and timer ticks from their
+   start until the child finished loading. */
+static long long exec_cnt;
+static int64_t exec_ticks;
+
 pid_t
 exec (const char *cmd_line)
 {
+	int64_t start = timer_ticks ();
 	pid_t pid = process_execute (cmd_line);
 	struct thread *cur = thread_current ();
 	struct list_elem *e;
@@ -272,6 +556,8 @@ exec (const char *cmd_line)
 				lock_release (&cur->load_lock);
 			}
 			if (child->load == LOAD_SUCCESS) {
+				exec_cnt++;
+				exec_ticks += timer_elapsed (start);
 				return pid;
 			} else {
 				list_remove (&child->child_elem);
@@ -283,6 +569,14 @@ exec (const char *cmd_line)
 	return -1;
 }
 
+/* Prints exec() statistics. */
+void
+syscall_print_stats (void)
+{
+	printf ("Exec: %lld execs, %"PRId64" ticks until loaded\n",
+			exec_cnt, exec_ticks);
+}
+
 int wait (pid_t pid)
 {
 	return process_wait(pid);
@@ -311,6 +605,101 @@ remove (const char *file)
 	return is_file_removed;
 }
 
+/*
+ * Creates an empty fd table in a block of PAGE_CNT pages, with fds
+ * 0 and 1 reserved for the console.  Returns a null pointer if the
+ * pages cannot be allocated.
+ */
+static struct fd_table *
+fd_table_create (size_t page_cnt)
+{
+	size_t size = page_cnt * PGSIZE;
+	struct fd_table *t = palloc_get_multiple (PAL_ZERO, page_cnt);
+	size_t slot_cnt;
+
+	if (t == NULL) {
+		return NULL;
+	}
+
+	/* Fit as many slots as we can, leaving room for the bitmap. */
+	slot_cnt = (size - sizeof *t) / sizeof *t->slots;
+	while (sizeof *t + slot_cnt * sizeof *t->slots
+			+ bitmap_buf_size (slot_cnt) > size) {
+		slot_cnt--;
+	}
+
+	t->page_cnt = page_cnt;
+	t->slot_cnt = slot_cnt;
+	t->used = bitmap_create_in_buf (slot_cnt, t->slots + slot_cnt,
+			size - ((uint8_t *) (t->slots + slot_cnt) - (uint8_t *) t));
+	bitmap_set_multiple (t->used, 0, 2, true);
+	return t;
+}
+
+/*
+ * Returns the running process's slot for FD, or a null pointer if
+ * FD is not open.
+ */
+static struct file_for_process *
+lookup_fd (int fd)
+{
+	struct fd_table *t = thread_current ()->fd_table;
+
+	if (t == NULL || fd < 2 || (size_t) fd >= t->slot_cnt
+			|| !bitmap_test (t->used, fd)) {
+		return NULL;
+	}
+	return &t->slots[fd];
+}
+
+/*
+ * Gives PROCESS_FILE the lowest free fd of the running process and
+ * returns it, doubling the table if it is full.  Returns -1 if no
+ * memory is available.
+ */
+static int
+install_fd (const struct file_for_process *process_file)
+{
+	struct thread *cur = thread_current ();
+	struct fd_table *t = cur->fd_table;
+	size_t fd;
+
+	if (t == NULL) {
+		t = cur->fd_table = fd_table_create (1);
+		if (t == NULL) {
+			return -1;
+		}
+	}
+
+	fd = bitmap_scan_and_flip (t->used, 0, 1, false);
+	if (fd == BITMAP_ERROR) {
+		struct fd_table *bigger = fd_table_create (t->page_cnt * 2);
+		if (bigger == NULL) {
+			return -1;
+		}
+		memcpy (bigger->slots, t->slots, t->slot_cnt * sizeof *t->slots);
+		bitmap_set_multiple (bigger->used, 0, t->slot_cnt, true);
+		palloc_free_multiple (t, t->page_cnt);
+		t = cur->fd_table = bigger;
+		fd = bitmap_scan_and_flip (t->used, 0, 1, false);
+	}
+
+	t->slots[fd] = *process_file;
+	return fd;
+}
+
+/*
+ * Frees FD of the running process for reuse.  FD must be open.
+ */
+static void
+release_fd (int fd)
+{
+	struct fd_table *t = thread_current ()->fd_table;
+
+	memset (&t->slots[fd], 0, sizeof t->slots[fd]);
+	bitmap_reset (t->used, fd);
+}
+
 int
 open (const char *file)
 {
@@ -322,17 +711,11 @@ open (const char *file)
 	if (file_to_open == NULL) {
 		is_open = -1;
 	} else {
-		struct thread *cur = thread_current ();
-		struct file_for_process *process_file =
-				malloc (sizeof *process_file);
-		if (process_file == NULL) {
-			is_open = -1;
-		} else {
-			process_file->fd = cur->fd;
-			process_file->file = file_to_open;
-			is_open = cur->fd;
-			cur->fd++;
-			list_push_back (&cur->opened_file_list, &process_file->file_elem);
+		struct file_for_process process_file;
+		process_file.file = file_to_open;
+		is_open = install_fd (&process_file);
+		if (is_open == -1) {
+			file_close (file_to_open);
 		}
 	}
 
@@ -343,28 +726,11 @@ open (const char *file)
 int
 filesize (int fd)
 {
-	lock_acquire (&file_lock);
-	int filesize = -1;
-
-	struct thread *cur = thread_current ();
-	struct list_elem *e;
-	for (e = list_begin (&cur->opened_file_list);
-			e != list_end (&cur->opened_file_list);
-			e = list_next(e)) {
-		struct file_for_process *process_file =
-				list_entry (e, struct file_for_process, file_elem);
-		if (process_file == NULL) {
-			filesize = -1;
-			break;
-		}
-		if (fd == process_file->fd) {
-			filesize = file_length (process_file->file);
-			break;
-		}
+	struct file_for_process *process_file = lookup_fd (fd);
+	if (process_file == NULL) {
+		return -1;
 	}
-
-	lock_release (&file_lock);
-	return filesize;
+	return file_length (process_file->file);
 }
 
 int
@@ -379,26 +745,10 @@ read (int fd, void *buffer, unsigned size)
 		}
 		return num_bytes_read;
 	}
-	lock_acquire (&file_lock);
-
-	struct thread *cur = thread_current ();
-	struct list_elem *e;
-	for (e = list_begin (&cur->opened_file_list);
-			e != list_end (&cur->opened_file_list);
-			e = list_next (e)) {
-		struct file_for_process *process_file =
-				list_entry (e, struct file_for_process, file_elem);
-		if (process_file == NULL) {
-			num_bytes_read = -1;
-			break;
-		}
-
-		if (fd == process_file->fd) {
-			num_bytes_read = file_read (process_file->file, buffer, size);
-			break;
-		}
+	struct file_for_process *process_file = lookup_fd (fd);
+	if (process_file != NULL) {
+		num_bytes_read = transfer_pinned (process_file->file, buffer, size, true);
 	}
-	lock_release (&file_lock);
 	return num_bytes_read;
 }
 
@@ -406,85 +756,195 @@ int
 write (int fd, const void *buffer, unsigned size)
 {
 	if (fd == 1) {
-		putbuf ((const char *) buffer, (size_t) size);
-		return size;
+		// putbuf() reads its buffer with interrupts off, where a
+		// fault on a non-resident user page must not happen, so
+		// pass it each page through its pinned frame instead.
+		const uint8_t *ubuf = buffer;
+		int total = 0;
+		while (size > 0) {
+			unsigned chunk = PGSIZE - pg_ofs (ubuf);
+			if (chunk > size) {
+				chunk = size;
+			}
+			const char *kaddr = frame_pin_user_page (ubuf);
+			if (kaddr == NULL) {
+				return total > 0 ? total : -1;
+			}
+			putbuf (kaddr, chunk);
+			frame_unpin ((void *) kaddr);
+			total += chunk;
+			ubuf += chunk;
+			size -= chunk;
+		}
+		return total;
 	}
-	lock_acquire (&file_lock);
 	int num_bytes_written = 0;
-	struct thread *cur = thread_current ();
-	struct list_elem *e;
-	for (e = list_begin (&cur->opened_file_list);
-			e != list_end (&cur->opened_file_list);
-			e = list_next(e)) {
-		struct file_for_process *process_file =
-				list_entry (e, struct file_for_process, file_elem);
-		if (process_file == NULL || process_file->file == NULL) {
-			num_bytes_written = 0;
-			break;
-		}
+	struct file_for_process *process_file = lookup_fd (fd);
+	if (process_file != NULL) {
+		num_bytes_written = transfer_pinned (process_file->file,
+				(uint8_t *) buffer, size, false);
+	}
+	return num_bytes_written;
+}
 
-		if (fd == process_file->fd) {
-			num_bytes_written =
-					file_write (process_file->file, buffer, size);
-			break;
+/*
+ * Reads or writes SIZE bytes between descriptor FD and the
+ * kernel buffer KBUF, at byte offset OFS or, if OFS is
+ * negative, at the file's current position.  Returns the
+ * number of bytes moved, or -1 if FD is not open or names
+ * the console along with an offset.
+ */
+static int
+transfer_at (int fd, void *kbuf, unsigned size, off_t ofs, bool is_read)
+{
+	struct file_for_process *process_file;
+
+	if (fd == 0 || fd == 1) {
+		if (ofs >= 0 || is_read != (fd == 0)) {
+			return -1;
 		}
+		return is_read ? read (fd, kbuf, size) : write (fd, kbuf, size);
+	}
+	process_file = lookup_fd (fd);
+	if (process_file == NULL) {
+		return -1;
+	}
+	if (ofs < 0) {
+		return is_read ? file_read (process_file->file, kbuf, size)
+				: file_write (process_file->file, kbuf, size);
 	}
+	return is_read ? file_read_at (process_file->file, kbuf, size, ofs)
+			: file_write_at (process_file->file, kbuf, size, ofs);
+}
 
-	lock_release (&file_lock);
-	return num_bytes_written;
+/*
+ * Copies SIZE bytes from the kernel buffer KBUF to the
+ * buffers in IOV, or from them into KBUF if TO_USER is
+ * false, starting *OFS bytes into *IOV.  Advances *IOV
+ * and *OFS past the bytes copied.  Returns false if a user
+ * page cannot be brought in, true otherwise.
+ */
+static bool
+copy_iov (const struct iovec **iov, size_t *ofs, uint8_t *kbuf, size_t size,
+		bool to_user, void *esp)
+{
+	while (size > 0) {
+		size_t chunk = (*iov)->iov_len - *ofs;
+		if (chunk == 0) {
+			(*iov)++;
+			*ofs = 0;
+			continue;
+		}
+		if (chunk > size) {
+			chunk = size;
+		}
+		if (!copy_user ((uint8_t *) (*iov)->iov_base + *ofs, kbuf, chunk,
+				to_user, esp)) {
+			return false;
+		}
+		*ofs += chunk;
+		kbuf += chunk;
+		size -= chunk;
+	}
+	return true;
 }
 
-void
-seek (int fd, unsigned position)
+/*
+ * Carries out readv, writev, pread and pwrite: moves the
+ * bytes of the IOVCNT user buffers in IOV to or from FD, at
+ * offset OFS or, if OFS is negative, at the file's current
+ * position.  The buffers are gathered into, or scattered
+ * from, a kernel buffer of up to VECTOR_IO_PAGES pages, so
+ * each file system call covers many buffers and sectors.
+ * Returns the number of bytes moved, or -1 on error.
+ */
+static int
+vector_io (int fd, const struct iovec *iov, int iovcnt, off_t ofs,
+		bool is_read, void *esp)
 {
-	lock_acquire (&file_lock);
-	struct thread *cur = thread_current ();
-	struct list_elem *e;
-	for (e = list_begin (&cur->opened_file_list);
-			e != list_end (&cur->opened_file_list);
-			e = list_next(e)) {
-		struct file_for_process *process_file =
-				list_entry (e, struct file_for_process, file_elem);
-		if (process_file == NULL) {
+	const struct iovec *cur = iov;
+	size_t cur_ofs = 0;
+	size_t total = 0;
+	size_t done = 0;
+	bool failed = false;
+	size_t page_cnt;
+	uint8_t *kbuf;
+	int i;
+
+	// Check every buffer before staging anything, so that a
+	// bad one cannot kill the process with KBUF allocated.
+	// Pages are pinned only while being copied; a page that
+	// cannot be brought in then ends the transfer early.
+	for (i = 0; i < iovcnt; i++) {
+		if (iov[i].iov_len > (size_t) INT_MAX - total) {
+			return -1;
+		}
+		check_buffer_validity (iov[i].iov_base, iov[i].iov_len, esp, is_read);
+		total += iov[i].iov_len;
+	}
+	if (total == 0) {
+		return 0;
+	}
+
+	page_cnt = DIV_ROUND_UP (total, PGSIZE);
+	if (page_cnt > VECTOR_IO_PAGES) {
+		page_cnt = VECTOR_IO_PAGES;
+	}
+	kbuf = palloc_get_multiple (0, page_cnt);
+	if (kbuf == NULL) {
+		page_cnt = 1;
+		kbuf = palloc_get_page (0);
+		if (kbuf == NULL) {
+			return -1;
+		}
+	}
+
+	while (done < total) {
+		size_t chunk = total - done;
+		int moved;
+
+		if (chunk > page_cnt * PGSIZE) {
+			chunk = page_cnt * PGSIZE;
+		}
+		if (!is_read && !copy_iov (&cur, &cur_ofs, kbuf, chunk, false, esp)) {
+			failed = true;
 			break;
 		}
-		if (fd == process_file->fd) {
-			if (process_file->file != NULL) {
-				file_seek (process_file->file, position);
-			}
+		moved = transfer_at (fd, kbuf, chunk, ofs, is_read);
+		if (moved < 0
+				|| (is_read && !copy_iov (&cur, &cur_ofs, kbuf, moved, true, esp))) {
+			failed = true;
+			break;
+		}
+		done += moved;
+		if (ofs >= 0) {
+			ofs += moved;
+		}
+		if ((size_t) moved < chunk) {
 			break;
 		}
 	}
-	lock_release (&file_lock);
+	palloc_free_multiple (kbuf, page_cnt);
+	return failed && done == 0 ? -1 : (int) done;
+}
+
+void
+seek (int fd, unsigned position)
+{
+	struct file_for_process *process_file = lookup_fd (fd);
+	if (process_file != NULL) {
+		file_seek (process_file->file, position);
+	}
 }
 
 unsigned
 tell (int fd)
 {
-	lock_acquire (&file_lock);
-	unsigned nxt_byte_pos = -1;
-	struct thread *cur = thread_current ();
-	struct list_elem *e;
-	for (e = list_begin (&cur->opened_file_list);
-			e != list_end (&cur->opened_file_list);
-			e = list_next(e)) {
-		struct file_for_process *process_file =
-				list_entry (e, struct file_for_process, file_elem);
-		if (process_file == NULL) {
-			nxt_byte_pos = -1;
-			break;
-		}
-		if (fd == process_file->fd) {
-			if (process_file->file == NULL) {
-				nxt_byte_pos = -1;
-			} else {
-				nxt_byte_pos = (file_tell (process_file->file));
-			}
-			break;
-		}
+	struct file_for_process *process_file = lookup_fd (fd);
+	if (process_file == NULL) {
+		return -1;
 	}
-	lock_release (&file_lock);
-	return nxt_byte_pos;
+	return file_tell (process_file->file);
 }
 
 void
@@ -496,53 +956,36 @@ close (int fd)
 void
 close_file (int fd)
 {
-	lock_acquire (&file_lock);
 	struct thread *cur = thread_current ();
-	struct list_elem *e, *next;
-	for (e = list_begin (&cur->opened_file_list);
-			e != list_end (&cur->opened_file_list);) {
-		next = list_next (e);
-		struct file_for_process *process_file =
-				list_entry (e, struct file_for_process, file_elem);
-		if (process_file == NULL) {
-			break;
-		}
+	struct fd_table *t = cur->fd_table;
 
-		// -1 stands for closing all file descriptors.
-		if (fd == -1) {
-			file_close (process_file->file);
-			list_remove (e);
-			free (process_file);
-		} else if (fd == process_file->fd) {
+	lock_acquire (&file_lock);
+	// -1 stands for closing all file descriptors.
+	if (fd == -1) {
+		if (t != NULL) {
+			size_t i;
+			for (i = bitmap_scan (t->used, 2, 1, true); i != BITMAP_ERROR;
+					i = bitmap_scan (t->used, i + 1, 1, true)) {
+				file_close (t->slots[i].file);
+			}
+			palloc_free_multiple (t, t->page_cnt);
+			cur->fd_table = NULL;
+		}
+	} else {
+		struct file_for_process *process_file = lookup_fd (fd);
+		if (process_file != NULL) {
 			file_close (process_file->file);
-			list_remove (e);
-			free (process_file);
-			break;
+			release_fd (fd);
 		}
-		e = next;
 	}
 	lock_release (&file_lock);
 }
 
 int mmap (int fd, void *addr)
 {
-	struct file *old_file = NULL;
-
 	struct thread *cur = thread_current ();
-	struct list_elem *e;
-	for (e = list_begin (&cur->opened_file_list);
-			e != list_end (&cur->opened_file_list);
-			e = list_next(e)) {
-		struct file_for_process *process_file =
-				list_entry (e, struct file_for_process, file_elem);
-		if (process_file == NULL) {
-			break;
-		}
-		if (fd == process_file->fd) {
-			old_file = process_file->file;
-			break;
-		}
-	}
+	struct file_for_process *process_file = lookup_fd (fd);
+	struct file *old_file = process_file != NULL ? process_file->file : NULL;
 
 	if ((old_file == NULL)
 			|| !is_user_vaddr(addr)
@@ -577,41 +1020,7 @@ int mmap (int fd, void *addr)
 
 void munmap (int map_id)
 {
-	struct thread *cur = thread_current ();
-	struct list_elem *e, *next;
-	bool close = false;
-
-	for (e = list_begin (&cur->mmap_list);
-			e != list_end (&cur->mmap_list);) {
-		next = list_next(e);
-		struct mmap_file *mmf = list_entry (e, struct mmap_file, mmap_elem);
-		if (mmf->map_id == map_id || map_id == -1)
-		{
-			if (mmf->pte->is_loaded)
-			{
-				if (pagedir_is_dirty(cur->pagedir, mmf->pte->vaddr))
-				{
-					file_write_at(mmf->pte->file, mmf->pte->vaddr, mmf->pte->read_bytes, mmf->pte->ofs);
-				}
-				deallocate_frame_entry (pagedir_get_page(cur->pagedir, mmf->pte->vaddr));
-				pagedir_clear_page (cur->pagedir, mmf->pte->vaddr);
-			}
-
-			if (mmf->pte->type != PAGE_HASH_ERROR)
-			{
-				hash_delete (&cur->page_table, &mmf->pte->page_elem);
-			}
-
-			list_remove (&mmf->mmap_elem);
-			if (close == false) {
-				file_close(mmf->pte->file);
-				close = true;
-			}
-			free (mmf->pte);
-			free (mmf);
-		}
-		e = next;
-	}
+	remove_process_mmap (map_id);
 }
 
 static bool insert_mmap_in_page_table(struct file *file, int32_t ofs, uint8_t *upage,
@@ -635,12 +1044,11 @@ static bool insert_mmap_in_page_table(struct file *file, int32_t ofs, uint8_t *u
 		pte->is_loaded = false;
 		pte->is_writable = writable;
 		pte->swap_offset = 0;
-		pte->is_pinned = false;
 		if (!add_process_mmap(pte)) {
 			free(pte);
 			return false;
 		}
-		if (hash_insert(&thread_current()->page_table, &pte->page_elem)) {
+		if (!page_table_insert (thread_current ()->page_table, pte)) {
 			pte->type = PAGE_HASH_ERROR;
 			return false;
 		}
@@ -664,6 +1072,92 @@ add_process_mmap (struct page_entry *pte)
 	return true;
 }
 
+/*
+ * Orders two mmap pages by the disk sector that backs them.
+ */
+static int
+compare_mmap_sectors (const void *a_, const void *b_)
+{
+	const struct page_entry *a = *(struct page_entry * const *) a_;
+	const struct page_entry *b = *(struct page_entry * const *) b_;
+	block_sector_t sa = inode_byte_to_sector (file_get_inode (a->file), a->ofs);
+	block_sector_t sb = inode_byte_to_sector (file_get_inode (b->file), b->ofs);
+	return sa < sb ? -1 : sa > sb;
+}
+
+/*
+ * Writes mmap page PTE back to its file if it is still dirty,
+ * and marks it clean.  The frame is pinned and written from its
+ * kernel address, so it cannot be evicted in the middle.
+ */
+static void
+write_back_mmap_page (struct page_entry *pte)
+{
+	struct thread *cur = thread_current ();
+	void *frame = frame_pin_upage (pte->vaddr);
+
+	// An evicted page was already written back by evict_frame().
+	if (frame == NULL) {
+		return;
+	}
+	if (pagedir_is_dirty (cur->pagedir, pte->vaddr)) {
+		file_write_at (pte->file, frame, pte->read_bytes, pte->ofs);
+		pagedir_set_dirty (cur->pagedir, pte->vaddr, false);
+	}
+	frame_unpin (frame);
+}
+
+/*
+ * Writes back the dirty resident pages of mapping MAPID, or of all
+ * mappings if MAPID is -1, sorted by disk sector so that the disk
+ * sweeps once instead of seeking between files and pages.  The
+ * pages stay mapped.  If the sort buffer cannot be allocated, the
+ * pages are written in mapping order instead.
+ */
+void
+write_back_mmap (int mapid)
+{
+	struct thread *cur = thread_current ();
+	struct page_entry **dirty;
+	struct list_elem *e;
+	size_t cnt = 0, i = 0;
+
+	for (e = list_begin (&cur->mmap_list); e != list_end (&cur->mmap_list);
+			e = list_next (e)) {
+		struct mmap_file *mmf = list_entry (e, struct mmap_file, mmap_elem);
+		if ((mmf->map_id == mapid || mapid == -1) && mmf->pte->is_loaded
+				&& pagedir_is_dirty (cur->pagedir, mmf->pte->vaddr)) {
+			cnt++;
+		}
+	}
+	if (cnt == 0) {
+		return;
+	}
+
+	dirty = malloc (cnt * sizeof *dirty);
+	for (e = list_begin (&cur->mmap_list); e != list_end (&cur->mmap_list);
+			e = list_next (e)) {
+		struct mmap_file *mmf = list_entry (e, struct mmap_file, mmap_elem);
+		if ((mmf->map_id == mapid || mapid == -1) && mmf->pte->is_loaded
+				&& pagedir_is_dirty (cur->pagedir, mmf->pte->vaddr)) {
+			if (dirty == NULL) {
+				write_back_mmap_page (mmf->pte);
+			} else if (i < cnt) {
+				dirty[i++] = mmf->pte;
+			}
+		}
+	}
+	if (dirty == NULL) {
+		return;
+	}
+
+	qsort (dirty, i, sizeof *dirty, compare_mmap_sectors);
+	for (cnt = 0; cnt < i; cnt++) {
+		write_back_mmap_page (dirty[cnt]);
+	}
+	free (dirty);
+}
+
 void
 remove_process_mmap (int mapid)
 {
@@ -671,6 +1165,8 @@ remove_process_mmap (int mapid)
 	struct list_elem *e, *next;
 	bool close = false;
 
+	write_back_mmap (mapid);
+
 	for (e = list_begin (&cur->mmap_list);
 			e != list_end (&cur->mmap_list);) {
 		next = list_next(e);
@@ -679,17 +1175,14 @@ remove_process_mmap (int mapid)
 		{
 			if (mmf->pte->is_loaded)
 			{
-				if (pagedir_is_dirty(cur->pagedir, mmf->pte->vaddr))
-				{
-					file_write_at(mmf->pte->file, mmf->pte->vaddr, mmf->pte->read_bytes, mmf->pte->ofs);
-				}
-				deallocate_frame_entry (pagedir_get_page(cur->pagedir, mmf->pte->vaddr));
+				void *frame = pagedir_get_page(cur->pagedir, mmf->pte->vaddr);
 				pagedir_clear_page (cur->pagedir, mmf->pte->vaddr);
+				deallocate_frame_entry (frame);
 			}
 
 			if (mmf->pte->type != PAGE_HASH_ERROR)
 			{
-				hash_delete (&cur->page_table, &mmf->pte->page_elem);
+				page_table_remove (cur->page_table, mmf->pte);
 			}
 
 			list_remove (&mmf->mmap_elem);
@@ -1,117 +1,299 @@
 #include "vm/frame.h"
+#include <string.h>
 #include "userprog/pagedir.h"
 #include "vm/page.h"
 #include "vm/swap.h"
 #include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/vaddr.h"
 
 unsigned
 frame_hash(const struct hash_elem *f_elem, void *aux UNUSED)
 {
 	const struct frame_entry *fe = hash_entry(f_elem, struct frame_entry, frame_elem);
-	return hash_bytes (&fe->vaddr, sizeof fe->vaddr);
+	return hash_ptr (fe->frame_ptr);
 }
 
 bool
 frame_less(const struct hash_elem *frame_a, const struct hash_elem *frame_b, void *aux UNUSED)
 {
 	const struct frame_entry *fa = hash_entry(frame_a, struct frame_entry, frame_elem);
-	const struct frame_entry *fb = hash_entry(frame_a, struct frame_entry, frame_elem);
-	return fa->vaddr < fb->vaddr;
+	const struct frame_entry *fb = hash_entry(frame_b, struct frame_entry, frame_elem);
+	return fa->frame_ptr < fb->frame_ptr;
 }
 
+/*
+ * Returns the frame table entry for kernel page FRAME, or NULL.
+ * ft_lock must be held.
+ */
+static struct frame_entry *
+find_frame_entry (void *frame)
+{
+	struct hash_elem *frame_elem;
+	struct frame_entry fe;
+	fe.frame_ptr = frame;
+	frame_elem = hash_find(&frame_table, &fe.frame_elem);
+	if(frame_elem) {
+		return hash_entry(frame_elem, struct frame_entry, frame_elem);
+	}
+	return NULL;
+}
+
+/*
+ * Picks a victim with the clock algorithm, writes it back to its
+ * file or to swap, unmaps it from its owner and drops it from the
+ * frame table.  Pinned frames are skipped.  The victim's kernel
+ * page is handed back for reuse, or NULL if every frame stayed
+ * pinned for two full sweeps.  ft_lock must be held.
+ */
 void *evict_frame (enum palloc_flags flags)
 {
 	struct hash_iterator frame_table_itr;
+	size_t budget = 2 * hash_size (&frame_table) + 1;
+
 	hash_first (&frame_table_itr, &frame_table);
-	struct page_entry *pe;
-	size_t size = 0;
+	while (budget-- > 0) {
+		struct hash_elem *e = hash_next (&frame_table_itr);
+		if (e == NULL) {
+			hash_first (&frame_table_itr, &frame_table);
+			e = hash_next (&frame_table_itr);
+			if (e == NULL) {
+				return NULL;
+			}
+		}
 
-	while (true) {
-		struct frame_entry *fte = hash_entry (hash_cur (&frame_table_itr), struct frame_entry, frame_elem);
+		struct frame_entry *fte = hash_entry (e, struct frame_entry, frame_elem);
+		if (fte->pin_cnt > 0) {
+			continue;
+		}
 
 		struct thread *fte_thread = retrieve_thread(fte->tid);
-		struct page_entry *pte = get_page_entry(fte->vaddr);
-
-		if (pte->is_pinned == false) {
-			if (pagedir_is_accessed(fte_thread->pagedir, fte->vaddr)) {
-				pagedir_set_accessed(fte_thread->pagedir, fte->vaddr, false);
-			} else {
-				if (pagedir_is_dirty(fte_thread->pagedir, fte->vaddr)) {
-
-					if (pte->type == PAGE_MMAP) {
-						file_write_at(pte->file, fte->frame_ptr,
-								pte->read_bytes,
-								pte->zero_bytes);
-					} else {
-						pte->type = PAGE_SWAP;
-						pte->swap_offset = swap_frame_out (fte->frame_ptr);
-					}
-				}
-				pte->is_loaded = false;
-				pagedir_clear_page(fte_thread->pagedir, fte->vaddr);
-				deallocate_frame_entry (fte->frame_ptr);
-				return allocate_frame_entry (flags, pte);
+		if (fte_thread == NULL || fte_thread->pagedir == NULL) {
+			continue;
+		}
+		struct page_entry *pte = page_table_lookup (fte_thread->page_table,
+				fte->vaddr);
+		if (pte == NULL) {
+			continue;
+		}
+
+		if (pagedir_is_accessed(fte_thread->pagedir, fte->vaddr)) {
+			pagedir_set_accessed(fte_thread->pagedir, fte->vaddr, false);
+			continue;
+		}
+
+		// Unmap first so the owner faults instead of writing
+		// into the frame while it is being written back.
+		bool is_dirty = pagedir_is_dirty(fte_thread->pagedir, fte->vaddr);
+		pagedir_clear_page(fte_thread->pagedir, fte->vaddr);
+		if (pte->type == PAGE_MMAP) {
+			if (is_dirty) {
+				file_write_at(pte->file, fte->frame_ptr,
+						pte->read_bytes, pte->ofs);
 			}
+		} else if (is_dirty || pte->type == PAGE_SWAP) {
+			pte->type = PAGE_SWAP;
+			pte->swap_offset = swap_frame_out (fte->frame_ptr);
 		}
-		size++;
-		fte = hash_next(&frame_table_itr);
-		if(size == hash_size(&frame_table)) {
-			hash_first(&frame_table_itr, &frame_table);
-			size = 0;
+		pte->is_loaded = false;
+
+		void *frame = fte->frame_ptr;
+		hash_delete(&frame_table, &fte->frame_elem);
+		free(fte);
+		if (flags & PAL_ZERO) {
+			memset (frame, 0, PGSIZE);
 		}
+		return frame;
 	}
+	return NULL;
+}
+
+/*
+ * Records FRAME, now backing PTE, in the frame table.  The frame
+ * starts out pinned; see allocate_frame_entry().
+ */
+static bool
+add_frame_entry (void *frame, struct page_entry *pte)
+{
+	fast_lock_acquire (&ft_lock);
+	struct frame_entry *fte = malloc (sizeof (struct frame_entry));
+	if (fte == NULL) {
+		fast_lock_release (&ft_lock);
+		return false;
+	}
+	fte->frame_ptr = frame;
+	fte->vaddr = pte->vaddr;
+	fte->tid = thread_current ()->tid;
+	fte->pin_cnt = 1;
+	hash_insert(&frame_table, &fte->frame_elem);
+	fast_lock_release (&ft_lock);
+	return true;
 }
 
+/*
+ * Returns a frame for PTE, evicting another page if the user pool
+ * is empty.  The frame comes back pinned so that it cannot be
+ * stolen while the caller fills and maps it; the caller drops the
+ * pin with frame_unpin() once the page is installed.
+ */
 void
 *allocate_frame_entry (enum palloc_flags flags, struct page_entry *pte)
 {
 	void *frame = palloc_get_page (flags);
 	if (!frame) {
-		lock_acquire (&ft_lock);
+		fast_lock_acquire (&ft_lock);
 		frame = evict_frame (flags);
-		lock_release(&ft_lock);
+		fast_lock_release (&ft_lock);
 		if (frame == NULL) {
-			PANIC ("Failed to evict a frame. Swap partiition is full too!");
+			// Every frame is pinned or swap is full; let the
+			// caller fail the fault or syscall.
+			return NULL;
 		}
 	}
 
-	lock_acquire (&ft_lock);
-	struct frame_entry *fte = malloc (sizeof (struct frame_entry));
-	if (fte == NULL) {
+	if (!add_frame_entry (frame, pte)) {
+		palloc_free_page (frame);
 		return NULL;
 	}
-	fte->frame_ptr = frame;
-	fte->vaddr = pte->vaddr;
-	fte->tid = thread_current ()->tid;
-	hash_insert(&frame_table, &fte->frame_elem);
-	lock_release (&ft_lock);
 	return frame;
 }
 
+/*
+ * Like allocate_frame_entry(), but only hands out a free frame:
+ * returns NULL instead of evicting when the user pool is empty.
+ */
+void
+*try_allocate_frame_entry (enum palloc_flags flags, struct page_entry *pte)
+{
+	void *frame = palloc_get_page (flags);
+	if (frame == NULL) {
+		return NULL;
+	}
+
+	if (!add_frame_entry (frame, pte)) {
+		palloc_free_page (frame);
+		return NULL;
+	}
+	return frame;
+}
+
+/*
+ * Removes FRAME from the frame table and returns it to the user
+ * pool.  Does nothing if FRAME is not in the table, e.g. because
+ * it has already been evicted.
+ */
 void
 deallocate_frame_entry (void *frame)
 {
-	struct hash_elem *frame_elem;
-	struct frame_entry fe;
-	lock_acquire (&ft_lock);
-	fe.frame_ptr = frame;
-	frame_elem = hash_find(&frame_table, &fe.frame_elem);
-	if(frame_elem) {
-		struct frame_entry *fte = hash_entry(frame_elem, struct frame_entry, frame_elem);
+	fast_lock_acquire (&ft_lock);
+	struct frame_entry *fte = find_frame_entry (frame);
+	if (fte) {
 		hash_delete(&frame_table, &fte->frame_elem);
 		free(fte);
+		palloc_free_page (frame);
 	}
-	lock_release (&ft_lock);
+	fast_lock_release (&ft_lock);
 }
 
-struct frame_entry *get_frame_entry (void *vaddr)
+/*
+ * Drops the frame table entry of the frame backing PTE in the
+ * running process, if any, and marks PTE not loaded.  ft_lock
+ * must be held.
+ */
+static void
+release_frame_action (struct page_entry *pte)
 {
-	struct hash_elem *frame_elem;
-	struct frame_entry fe;
-	fe.vaddr = vaddr;
-	frame_elem = hash_find(&frame_table, &fe.frame_elem);
-	if(frame_elem) {
-		return hash_entry(frame_elem, struct frame_entry, frame_elem);
+	void *frame = pagedir_get_page (thread_current ()->pagedir, pte->vaddr);
+	if (frame != NULL) {
+		struct frame_entry *fte = find_frame_entry (frame);
+		if (fte != NULL) {
+			hash_delete(&frame_table, &fte->frame_elem);
+			free(fte);
+		}
 	}
-	return NULL;
+	pte->is_loaded = false;
+}
+
+/*
+ * Drops all of the running process's frames from the frame table,
+ * taking ft_lock once for the whole address space instead of once
+ * per page.  The frames stay mapped in the page directory, and
+ * pagedir_destroy() returns them to the user pool; with no frame
+ * table entry left, evict_frame() can no longer pick them.  Used
+ * at process exit, after mmap pages have been written back.
+ */
+void
+frame_release_process (void)
+{
+	struct thread *cur = thread_current ();
+
+	if (cur->pagedir == NULL) {
+		return;
+	}
+	fast_lock_acquire (&ft_lock);
+	page_table_for_each (cur->page_table, release_frame_action);
+	fast_lock_release (&ft_lock);
+}
+
+/*
+ * Pins the frame currently backing user page UPAGE of the running
+ * process and returns its kernel address, or NULL if UPAGE is not
+ * resident.  Checking residency and taking the pin under ft_lock
+ * closes the window in which the page could be evicted.
+ */
+void *
+frame_pin_upage (const void *upage)
+{
+	struct thread *cur = thread_current ();
+	void *frame;
+
+	fast_lock_acquire (&ft_lock);
+	frame = pagedir_get_page (cur->pagedir, upage);
+	if (frame != NULL) {
+		struct frame_entry *fte = find_frame_entry (pg_round_down (frame));
+		if (fte != NULL) {
+			fte->pin_cnt++;
+		} else {
+			frame = NULL;
+		}
+	}
+	fast_lock_release (&ft_lock);
+	return frame;
+}
+
+/*
+ * Drops one pin on FRAME, a kernel address anywhere in the page.
+ */
+void
+frame_unpin (void *frame)
+{
+	fast_lock_acquire (&ft_lock);
+	struct frame_entry *fte = find_frame_entry (pg_round_down (frame));
+	if (fte != NULL) {
+		ASSERT (fte->pin_cnt > 0);
+		fte->pin_cnt--;
+	}
+	fast_lock_release (&ft_lock);
+}
+
+/*
+ * Makes the user page holding UADDR resident and pins it, and
+ * returns the kernel address that corresponds to UADDR, so that
+ * the kernel can copy through it without faulting.  A page that
+ * is evicted between being loaded and being pinned is simply
+ * loaded again.  Returns NULL if the page cannot be brought in.
+ */
+void *
+frame_pin_user_page (const void *uaddr)
+{
+	void *upage = pg_round_down (uaddr);
+	uint8_t *frame;
+
+	while ((frame = frame_pin_upage (upage)) == NULL) {
+		struct page_entry *pte = get_page_entry (upage);
+		if (pte == NULL || (!pte->is_loaded && !load_page (pte))) {
+			return NULL;
+		}
+	}
+	return frame + pg_ofs (uaddr);
 }
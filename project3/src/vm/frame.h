@@ -10,21 +10,28 @@ struct frame_entry {
 	void *frame_ptr;				// Address of frame.
 	void *vaddr;					// Virtual Address corresponding to frame enrty.
 	tid_t tid;						// Id of the thread to whom page corresponding to the frame entry belongs.
+	unsigned pin_cnt;				// Number of pins; evict_frame() skips the frame while nonzero.
 	struct hash_elem frame_elem;	// List elem for adding in frame_table list.
 };
 
-// Data structure to store mapping of user virtual address to physical address on memory
+// Data structure to store mapping of physical frame to user virtual address, keyed by frame
 struct hash frame_table;
 
 // This is the lock that a thread/process has to acquire
 // when perfoming any operation on the frame table. This
 // is added for synchronization purposes.
-struct lock ft_lock;
+struct fast_lock ft_lock;
 
 unsigned frame_hash (const struct hash_elem *f_elem, void *aux);
 bool frame_less (const struct hash_elem *frame_a, const struct hash_elem *frame_b, void *aux);
 void* allocate_frame_entry (enum palloc_flags flags, struct page_entry *pte);
+void* try_allocate_frame_entry (enum palloc_flags flags, struct page_entry *pte);
 void deallocate_frame_entry (void *frame);
+void frame_release_process (void);
 void* evict_frame (enum palloc_flags flags);
 
+void *frame_pin_upage (const void *upage);
+void frame_unpin (void *frame);
+void *frame_pin_user_page (const void *uaddr);
+
 #endif
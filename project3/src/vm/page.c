@@ -2,49 +2,192 @@
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
+#include "threads/pte.h"
 #include "threads/vaddr.h"
+#include "filesys/inode.h"
+#include "userprog/exec-cache.h"
 #include "userprog/process.h"
 #include "userprog/pagedir.h"
 #include "vm/frame.h"
 #include "vm/page.h"
 #include "vm/swap.h"
 
-unsigned page_hash (const struct hash_elem *e, void *aux UNUSED)
+size_t fault_around_pages = FAULT_AROUND_DEFAULT;
+size_t stack_growth_pages = STACK_GROWTH_DEFAULT;
+
+/*
+ * Reads the file contents described by PTE into FRAME and zeroes
+ * the rest of the page.
+ */
+static bool
+read_page_into_frame (struct page_entry *pte, uint8_t *frame)
+{
+	/* Read-only executable pages are kept warm in the exec cache. */
+	bool is_text = pte->type == PAGE_FILE && pte->file != NULL
+			&& !pte->is_writable;
+	block_sector_t inumber = 0;
+
+	if (is_text) {
+		inumber = inode_get_inumber (file_get_inode (pte->file));
+		if (exec_cache_read_page (inumber, pte->ofs, pte->read_bytes, frame)) {
+			return true;
+		}
+	}
+
+	if (pte->file != NULL && (int) pte->read_bytes
+			!= file_read_at (pte->file, frame, pte->read_bytes, pte->ofs)) {
+		return false;
+	}
+	memset (frame + pte->read_bytes, 0, pte->zero_bytes);
+
+	if (is_text) {
+		exec_cache_save_page (inumber, pte->ofs, pte->read_bytes, frame);
+	}
+	return true;
+}
+
+/*
+ * Returns the slot for VADDR in PT.  If the second-level table for
+ * VADDR is missing, creates it when CREATE is true and returns a
+ * null pointer otherwise.
+ */
+static struct page_entry **
+lookup_slot (struct page_table *pt, const void *vaddr, bool create)
+{
+	struct page_entry ***tablep;
+
+	if (pt == NULL || !is_user_vaddr (vaddr)) {
+		return NULL;
+	}
+
+	tablep = &pt->tables[pd_no (vaddr)];
+	if (*tablep == NULL) {
+		if (!create) {
+			return NULL;
+		}
+		*tablep = palloc_get_page (PAL_ZERO);
+		if (*tablep == NULL) {
+			return NULL;
+		}
+	}
+	return &(*tablep)[pt_no (vaddr)];
+}
+
+/*
+ * Creates an empty supplemental page table.  Returns a null
+ * pointer if memory allocation fails.
+ */
+struct page_table *
+page_table_create (void)
+{
+	return palloc_get_page (PAL_ZERO);
+}
+
+/*
+ * Calls ACTION on every entry of PT in ascending address order,
+ * then frees PT and all of its second-level tables.
+ */
+void
+page_table_destroy (struct page_table *pt, page_action_func *action)
+{
+	size_t pde, i;
+
+	if (pt == NULL) {
+		return;
+	}
+
+	for (pde = 0; pde < pd_no (PHYS_BASE); pde++) {
+		struct page_entry **table = pt->tables[pde];
+		if (table == NULL) {
+			continue;
+		}
+		for (i = 0; i < PGSIZE / sizeof *table; i++) {
+			if (table[i] != NULL && action != NULL) {
+				action (table[i]);
+			}
+		}
+		palloc_free_page (table);
+	}
+	palloc_free_page (pt);
+}
+
+/*
+ * Calls ACTION on every entry of PT in ascending address order.
+ */
+void
+page_table_for_each (struct page_table *pt, page_action_func *action)
+{
+	size_t pde, i;
+
+	if (pt == NULL) {
+		return;
+	}
+
+	for (pde = 0; pde < pd_no (PHYS_BASE); pde++) {
+		struct page_entry **table = pt->tables[pde];
+		if (table == NULL) {
+			continue;
+		}
+		for (i = 0; i < PGSIZE / sizeof *table; i++) {
+			if (table[i] != NULL) {
+				action (table[i]);
+			}
+		}
+	}
+}
+
+/*
+ * Returns the entry in PT for the page containing VADDR, or a null
+ * pointer if there is none.
+ */
+struct page_entry *
+page_table_lookup (struct page_table *pt, const void *vaddr)
+{
+	struct page_entry **slot = lookup_slot (pt, vaddr, false);
+	return slot != NULL ? *slot : NULL;
+}
+
+/*
+ * Adds PTE to PT.  Returns false if PTE's page is already present
+ * or if memory allocation fails.
+ */
+bool
+page_table_insert (struct page_table *pt, struct page_entry *pte)
 {
-	struct page_entry *pte = hash_entry(e, struct page_entry, page_elem);
-	return hash_bytes (&pte->vaddr, sizeof pte->vaddr);
+	struct page_entry **slot = lookup_slot (pt, pte->vaddr, true);
+	if (slot == NULL || *slot != NULL) {
+		return false;
+	}
+	*slot = pte;
+	return true;
 }
 
-bool page_less (const struct hash_elem *a,
-		const struct hash_elem *b,
-		void *aux UNUSED)
+/*
+ * Removes PTE from PT, if present.  Does not free PTE.
+ */
+void
+page_table_remove (struct page_table *pt, struct page_entry *pte)
 {
-	struct page_entry *page_entry_a = hash_entry(a, struct page_entry, page_elem);
-	struct page_entry *page_entry_b = hash_entry(b, struct page_entry, page_elem);
-	return page_entry_a->vaddr < page_entry_b->vaddr;
+	struct page_entry **slot = lookup_slot (pt, pte->vaddr, false);
+	if (slot != NULL && *slot == pte) {
+		*slot = NULL;
+	}
 }
 
-void page_destroy_action (struct hash_elem *e, void *aux UNUSED)
+void page_destroy_action (struct page_entry *pte)
 {
 	struct thread *cur = thread_current ();
-	struct page_entry *pte = hash_entry(e, struct page_entry, page_elem);
 	if (pte->is_loaded) {
-		deallocate_frame_entry (pagedir_get_page (cur->pagedir, pte->vaddr));
+		void *frame = pagedir_get_page (cur->pagedir, pte->vaddr);
 		pagedir_clear_page (cur->pagedir, pte->vaddr);
+		deallocate_frame_entry (frame);
 	}
 	free(pte);
 }
 
 struct page_entry *get_page_entry (void *vaddr)
 {
-	struct page_entry pte;
-	pte.vaddr = pg_round_down(vaddr);
-
-	struct hash_elem *he = hash_find (&thread_current()->page_table, &pte.page_elem);
-	if (he) {
-		return hash_entry (he, struct page_entry, page_elem);
-	}
-	return NULL;
+	return page_table_lookup (thread_current ()->page_table, vaddr);
 }
 
 bool load_swap (struct page_entry *pte)
@@ -56,10 +199,9 @@ bool load_swap (struct page_entry *pte)
 			return false;
 		}
 
-		pte->is_pinned = true;
-		swap_frame_in (pte->swap_offset, pte->vaddr);
-		pte->is_pinned = false;
+		swap_frame_in (pte->swap_offset, frame);
 		pte->is_loaded = true;
+		frame_unpin (frame);
 		return pte->is_loaded;
 	}
 	return false;
@@ -74,14 +216,10 @@ bool load_file (struct page_entry *pte)
 {
 	uint8_t *frame = allocate_frame_entry (PAL_USER, pte);
 	if (frame) {
-		pte->is_pinned = true;
-		if ((int) pte->read_bytes != file_read_at(pte->file, frame,
-				pte->read_bytes, pte->ofs)) {
+		if (!read_page_into_frame (pte, frame)) {
 			deallocate_frame_entry (frame);
 			return false;
 		}
-		pte->is_pinned = false;
-		memset (frame + pte->read_bytes, 0, pte->zero_bytes);
 		bool is_page_installed = install_page(pte->vaddr, frame, pte->is_writable);
 
 		if (is_page_installed == false) {
@@ -90,45 +228,178 @@ bool load_file (struct page_entry *pte)
 		}
 
 		pte->is_loaded = true;
+		frame_unpin (frame);
 		return pte->is_loaded;
 	}
 	return false;
 }
 
+/*
+ * Brings in the not yet loaded page PTE from wherever it lives.
+ */
 bool
-grow_stack (void *vaddr)
+load_page (struct page_entry *pte)
 {
-	void *rounded_vaddr = pg_round_down (vaddr);
-	if (STACK_MAX_SIZE <= (size_t) (PHYS_BASE - pg_round_down(vaddr))) {
+	switch (pte->type) {
+	case PAGE_FILE:
+	case PAGE_ZERO:
+		return load_file (pte);
+	case PAGE_SWAP:
+		return load_swap (pte);
+	case PAGE_MMAP:
+		return load_mmap (pte);
+	default:
 		return false;
 	}
+}
 
-	struct page_entry *pte = get_page_entry (rounded_vaddr);
-	if (pte == NULL) {
-		struct page_entry *pte = malloc (sizeof (struct page_entry));
-		if (pte == NULL) {
-			return false;
+/*
+ * Maps not yet loaded pages following PTE that are of the same
+ * type and file as PTE.  Only free frames are used, and the walk
+ * stops at the first page that cannot be mapped or after BUDGET
+ * pages.  Returns the number of pages mapped.
+ */
+static size_t
+map_neighbours (struct page_entry *pte, size_t budget)
+{
+	uint8_t *vaddr = pte->vaddr;
+	size_t mapped = 0;
+
+	while (mapped < budget) {
+		vaddr += PGSIZE;
+		if (!is_user_vaddr (vaddr)) {
+			break;
 		}
 
-		pte->vaddr = rounded_vaddr;
-		pte->type = PAGE_SWAP;
-		pte->is_loaded = true;
-		pte->is_writable = true;
-		pte->is_pinned = false;
+		struct page_entry *next = get_page_entry (vaddr);
+		if (next == NULL || next->is_loaded
+				|| next->type != pte->type || next->file != pte->file) {
+			break;
+		}
 
-		uint8_t *frame = allocate_frame_entry (PAL_USER, pte);
+		uint8_t *frame = try_allocate_frame_entry (PAL_USER, next);
 		if (frame == NULL) {
-			free (pte);
-			return false;
+			break;
 		}
 
-		bool page_installed = install_page (pte->vaddr, frame, pte->is_writable);
-		if (page_installed == false) {
-			free (pte);
+		if (!read_page_into_frame (next, frame)
+				|| !install_page (next->vaddr, frame, next->is_writable)) {
 			deallocate_frame_entry (frame);
-			return false;
+			break;
 		}
-		return (hash_insert (&thread_current ()->page_table, &pte->page_elem) == NULL);
+		next->is_loaded = true;
+		frame_unpin (frame);
+		mapped++;
 	}
-	return false;
+	return mapped;
+}
+
+/*
+ * Maps up to fault_around_pages not yet loaded pages that follow
+ * PTE in the same file or mmap region, so that a sequential scan
+ * takes one fault per window instead of one per page.  For a
+ * reserved stack page this maps the reserved pages above it, which
+ * lie above the stack pointer.
+ * Fault-around never evicts.  Returns the number of extra pages
+ * mapped.
+ */
+size_t
+fault_around (struct page_entry *pte)
+{
+	switch (pte->type) {
+	case PAGE_FILE:
+	case PAGE_MMAP:
+	case PAGE_ZERO:
+		return map_neighbours (pte, fault_around_pages);
+	default:
+		return 0;
+	}
+}
+
+/*
+ * Returns true if user page UPAGE lies within the STACK_MAX_SIZE
+ * bytes below PHYS_BASE.
+ */
+static bool
+is_stack_page (const uint8_t *upage)
+{
+	return is_user_vaddr (upage)
+			&& (size_t) ((uint8_t *) PHYS_BASE - upage) < STACK_MAX_SIZE;
+}
+
+/*
+ * Adds a lazily zero-filled stack page at UPAGE to the current
+ * process's page table.  Returns the new entry, or NULL on failure.
+ */
+static struct page_entry *
+reserve_stack_page (uint8_t *upage)
+{
+	struct page_entry *pte = malloc (sizeof (struct page_entry));
+	if (pte == NULL) {
+		return NULL;
+	}
+
+	pte->vaddr = upage;
+	pte->file = NULL;
+	pte->type = PAGE_ZERO;
+	pte->ofs = 0;
+	pte->read_bytes = 0;
+	pte->zero_bytes = PGSIZE;
+	pte->is_loaded = false;
+	pte->is_writable = true;
+	pte->swap_offset = 0;
+	if (!page_table_insert (thread_current ()->page_table, pte)) {
+		free (pte);
+		return NULL;
+	}
+	return pte;
+}
+
+/*
+ * Grows the stack to cover VADDR.  Rather than one page per fault,
+ * the whole hole between VADDR and the current bottom of the stack
+ * plus up to stack_growth_pages - 1 pages below VADDR are entered
+ * in the page table in one go, as zero pages that only get a frame
+ * when touched.  The page containing VADDR is loaded right away,
+ * and so is as much of the hole above it as free frames allow: it
+ * all lies above the stack pointer, so a large stack array takes a
+ * single fault.  Reserved pages below VADDR are still subject to
+ * the usual stack access check, so they are loaded one fault at a
+ * time as the stack pointer reaches them.
+ */
+bool
+grow_stack (void *vaddr)
+{
+	uint8_t *fault_page = pg_round_down (vaddr);
+	uint8_t *upage;
+	size_t hole_pages = 0;
+	size_t i;
+
+	if (!is_stack_page (fault_page) || get_page_entry (fault_page) != NULL) {
+		return false;
+	}
+
+	for (upage = fault_page + PGSIZE;
+			is_stack_page (upage) && get_page_entry (upage) == NULL;
+			upage += PGSIZE) {
+		if (reserve_stack_page (upage) == NULL) {
+			break;
+		}
+		hole_pages++;
+	}
+	for (i = 1, upage = fault_page - PGSIZE;
+			i < stack_growth_pages && is_stack_page (upage)
+					&& get_page_entry (upage) == NULL;
+			i++, upage -= PGSIZE) {
+		if (reserve_stack_page (upage) == NULL) {
+			break;
+		}
+	}
+
+	struct page_entry *pte = reserve_stack_page (fault_page);
+	if (pte == NULL || !load_page (pte)) {
+		return false;
+	}
+	map_neighbours (pte, hole_pages);
+	return true;
 }
@@ -1,18 +1,25 @@
 #ifndef VM_PAGE_H
 #define VM_PAGE_H
 
-#include <hash.h>
 #include "filesys/file.h"
+#include "threads/vaddr.h"
 #include "vm/frame.h"
 
 #define STACK_MAX_SIZE 0x800000		// 8MB
 
+// Default number of neighbouring pages mapped on a file/mmap fault.
+#define FAULT_AROUND_DEFAULT 4
+
+// Default number of stack pages reserved by one stack growth fault (64 kB).
+#define STACK_GROWTH_DEFAULT 16
+
 // Different types of pages.
 enum page_type
 {
 	PAGE_FILE,
 	PAGE_SWAP,
 	PAGE_MMAP,
+	PAGE_ZERO,
 	PAGE_HASH_ERROR
 };
 
@@ -25,19 +32,46 @@ struct page_entry {
 	size_t zero_bytes;             // number of zero bytes
 	bool is_loaded;               // whether page is loaded or not
 	bool is_writable;             // whether page is writable or not
-	bool is_pinned;               // used for synchronization during eviction
-	struct hash_elem page_elem;  // hash elem for page table entry
 	off_t swap_offset;            // swap offset for page entry
 };
 
-unsigned page_hash (const struct hash_elem *pg_elem, void *aux);
-bool page_less (const struct hash_elem *a, const struct hash_elem *b, void *aux);
-void page_destroy_action (struct hash_elem *he, void *aux);
+// Number of pages fault_around() tries to map after the faulting
+// page.  Set by the "-fa" kernel command-line option.
+extern size_t fault_around_pages;
+
+// Number of stack pages grow_stack() reserves, counting down from
+// the faulting page.  Reserved pages below the fault are still
+// loaded one fault at a time.  Set by the "-sg" kernel command-line
+// option.
+extern size_t stack_growth_pages;
+
+/*
+ * Supplemental page table.  A two-level radix tree with the same
+ * shape as the x86 page directory (see userprog/pagedir.c): TABLES
+ * is indexed by pd_no() and each present second-level table is a
+ * page of page_entry pointers indexed by pt_no().  Lookups are two
+ * array reads, and walking the tables visits pages in address order.
+ */
+struct page_table {
+	struct page_entry **tables[PGSIZE / sizeof (struct page_entry **)];
+};
+
+typedef void page_action_func (struct page_entry *pte);
+
+struct page_table *page_table_create (void);
+void page_table_destroy (struct page_table *pt, page_action_func *action);
+void page_table_for_each (struct page_table *pt, page_action_func *action);
+struct page_entry *page_table_lookup (struct page_table *pt, const void *vaddr);
+bool page_table_insert (struct page_table *pt, struct page_entry *pte);
+void page_table_remove (struct page_table *pt, struct page_entry *pte);
+void page_destroy_action (struct page_entry *pte);
 
 bool load_file (struct page_entry *pte);
 bool load_swap (struct page_entry *pte);
 bool load_mmap (struct page_entry *pte);
+bool load_page (struct page_entry *pte);
 bool grow_stack (void *vaddr);
+size_t fault_around (struct page_entry *pte);
 struct page_entry *get_page_entry (void *vaddr);
 
 #endif
@@ -4,7 +4,7 @@
 #include "devices/block.h"
 #include <bitmap.h>
 
-struct lock swap_lock;
+struct fast_lock swap_lock;
 struct block *swap_block;
 struct bitmap *swap_bitmap;
 
@@ -18,7 +18,7 @@ void initialize_swap_slot (void)
 				block_size (swap_block) / NUM_SECTORS_PER_PAGE);
 		if (swap_bitmap) {
 			bitmap_set_all (swap_bitmap, 0); // free swap slot
-			lock_init (&swap_lock);
+			fast_lock_init (&swap_lock, "swap_lock");
 		}
 	}
 }
@@ -27,17 +27,19 @@ void swap_frame_in(size_t used_index, void* frame)
 {
 	int i;
 	if (swap_block && swap_bitmap) {
-		lock_acquire (&swap_lock);
-		if (bitmap_test (swap_bitmap, used_index) == 0) { // 0 is free swap slot
-			lock_release (&swap_lock);
-			PANIC ("Cannot swap in a free block.");
-		}
-		bitmap_flip (swap_bitmap, used_index);
+		// The slot stays allocated until it has been read back, so
+		// swap_lock only needs to cover the bitmap, not the disk I/O.
 		for (i = 0; i < NUM_SECTORS_PER_PAGE; i++) {
 			block_read (swap_block, used_index * NUM_SECTORS_PER_PAGE + i,
 					(uint8_t *) frame + i * BLOCK_SECTOR_SIZE);
 		}
-		lock_release (&swap_lock);
+		fast_lock_acquire (&swap_lock);
+		if (bitmap_test (swap_bitmap, used_index) == 0) { // 0 is free swap slot
+			fast_lock_release (&swap_lock);
+			PANIC ("Cannot swap in a free block.");
+		}
+		bitmap_flip (swap_bitmap, used_index);
+		fast_lock_release (&swap_lock);
 	}
 }
 
@@ -53,18 +55,19 @@ size_t swap_frame_out(void *frame)
 		PANIC ("No swap bitmap available.");
 	}
 
-	lock_acquire (&swap_lock);
+	fast_lock_acquire (&swap_lock);
 	idx = bitmap_scan_and_flip (swap_bitmap, 0, 1, 0); // 0 is free swap slot
 	if (idx == BITMAP_ERROR) {
-		lock_release(&swap_lock);
+		fast_lock_release (&swap_lock);
 		PANIC ("Swap slot is full.");
 	}
+	fast_lock_release (&swap_lock);
 
+	// The slot is ours once flipped; write it without holding the lock.
 	for (i = 0; i < NUM_SECTORS_PER_PAGE; i++) {
 		block_write (swap_block, idx * NUM_SECTORS_PER_PAGE + i,
 				(uint8_t *) frame + i * BLOCK_SECTOR_SIZE);
 	}
 
-	lock_release (&swap_lock);
 	return idx;
 }
@@ -1,7 +1,7 @@
 #include "devices/serial.h"
 #include <debug.h>
+#include <string.h>
 #include "devices/input.h"
-#include "devices/intq.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
@@ -51,12 +51,22 @@
 /* Transmission mode. */
 static enum { UNINIT, POLL, QUEUE } mode;
 
-/* Data to be transmitted. */
-static struct intq txq;
+/* Transmit ring: bytes waiting to go out the port.  Much larger
+   than an intq, so a burst of console output queues without
+   stalling the writer.  Only serial_putbuf() adds bytes and only
+   serial_interrupt() and serial_flush() remove them, each moving
+   just its own index, so the two ends share no lock.  The indexes
+   count bytes ever queued and ever sent. */
+#define TXQ_SIZE 4096                   /* Power of 2. */
+static uint8_t txq[TXQ_SIZE];
+static size_t txq_head;                 /* Bytes queued so far. */
+static size_t txq_tail;                 /* Bytes sent so far. */
 
 static void set_serial (int bps);
 static void putc_poll (uint8_t);
 static void write_ier (void);
+static size_t txq_used (void);
+static uint8_t txq_getc (void);
 static intr_handler_func serial_interrupt;
 
 /* Initializes the serial port device for polling mode.
@@ -71,7 +81,6 @@ init_poll (void)
   outb (FCR_REG, 0);                    /* Disable FIFO. */
   set_serial (9600);                    /* 9.6 kbps, N-8-1. */
   outb (MCR_REG, MCR_OUT2);             /* Required to enable interrupts. */
-  intq_init (&txq);
   mode = POLL;
 } 
 
@@ -97,34 +106,65 @@ serial_init_queue (void)
 /* Sends BYTE to the serial port. */
 void
 serial_putc (uint8_t byte) 
+{
+  serial_putbuf (&byte, 1);
+}
+
+/* Sends the N bytes in BUFFER to the serial port.  In queued
+   mode, copies them into the transmit ring in as few pieces as
+   its free space allows, updating the interrupt enable register
+   once per piece rather than once per byte. */
+void
+serial_putbuf (const uint8_t *buffer, size_t n) 
 {
   enum intr_level old_level = intr_disable ();
 
   if (mode != QUEUE)
     {
       /* If we're not set up for interrupt-driven I/O yet,
-         use dumb polling to transmit a byte. */
+         use dumb polling to transmit the bytes. */
       if (mode == UNINIT)
         init_poll ();
-      putc_poll (byte); 
+      while (n-- > 0)
+        putc_poll (*buffer++); 
     }
   else 
-    {
-      /* Otherwise, queue a byte and update the interrupt enable
-         register. */
-      if (old_level == INTR_OFF && intq_full (&txq)) 
-        {
-          /* Interrupts are off and the transmit queue is full.
-             If we wanted to wait for the queue to empty,
-             we'd have to reenable interrupts.
-             That's impolite, so we'll send a character via
-             polling instead. */
-          putc_poll (intq_getc (&txq)); 
-        }
-
-      intq_putc (&txq, byte); 
-      write_ier ();
-    }
+    while (n > 0) 
+      {
+        size_t room = TXQ_SIZE - txq_used ();
+        size_t ofs, chunk;
+
+        if (room == 0) 
+          {
+            if (old_level == INTR_OFF)
+              {
+                /* Interrupts are off and the transmit ring is
+                   full.  Turning them on to wait would be
+                   impolite, so send a byte by polling instead. */
+                putc_poll (txq_getc ());
+              }
+            else 
+              {
+                /* Let the interrupt handler drain the ring. */
+                intr_set_level (INTR_ON);
+                while (txq_used () == TXQ_SIZE)
+                  barrier ();
+                intr_disable ();
+              }
+            continue;
+          }
+
+        /* Copy as much as fits before the end of the ring. */
+        ofs = txq_head % TXQ_SIZE;
+        chunk = n < room ? n : room;
+        if (chunk > TXQ_SIZE - ofs)
+          chunk = TXQ_SIZE - ofs;
+        memcpy (txq + ofs, buffer, chunk);
+        txq_head += chunk;
+        buffer += chunk;
+        n -= chunk;
+        write_ier ();
+      }
   
   intr_set_level (old_level);
 }
@@ -135,8 +175,8 @@ void
 serial_flush (void) 
 {
   enum intr_level old_level = intr_disable ();
-  while (!intq_empty (&txq))
-    putc_poll (intq_getc (&txq));
+  while (txq_used () > 0)
+    putc_poll (txq_getc ());
   intr_set_level (old_level);
 }
 
@@ -182,7 +222,7 @@ write_ier (void)
 
   /* Enable transmit interrupt if we have any characters to
      transmit. */
-  if (!intq_empty (&txq))
+  if (txq_used () > 0)
     ier |= IER_XMIT;
 
   /* Enable receive interrupt if we have room to store any
@@ -193,6 +233,23 @@ write_ier (void)
   outb (IER_REG, ier);
 }
 
+/* Returns the number of bytes in the transmit ring. */
+static size_t
+txq_used (void) 
+{
+  return txq_head - txq_tail;
+}
+
+/* Removes and returns the oldest byte in the transmit ring,
+   which must not be empty. */
+static uint8_t
+txq_getc (void) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (txq_used () > 0);
+  return txq[txq_tail++ % TXQ_SIZE];
+}
+
 /* Polls the serial port until it's ready,
    and then transmits BYTE. */
 static void
@@ -220,8 +277,8 @@ serial_interrupt (struct intr_frame *f UNUSED)
 
   /* As long as we have a byte to transmit, and the hardware is
      ready to accept a byte for transmission, transmit a byte. */
-  while (!intq_empty (&txq) && (inb (LSR_REG) & LSR_THRE) != 0) 
-    outb (THR_REG, intq_getc (&txq));
+  while (txq_used () > 0 && (inb (LSR_REG) & LSR_THRE) != 0) 
+    outb (THR_REG, txq_getc ());
 
   /* Update interrupt enable register based on queue status. */
   write_ier ();
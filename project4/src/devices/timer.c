@@ -24,11 +24,44 @@ static int64_t ticks;
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
+/* PIT cycles per timer tick.  Time below tick resolution is kept
+   in PIT cycles since boot, so tick N starts at cycle
+   N * TIMER_CYCLES. */
+#define TIMER_CYCLES ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+
+/* Channel 0 normally runs in periodic mode, interrupting on every
+   tick boundary.  It switches to one-shot mode to interrupt at the
+   deadline of a sub-tick sleep, or, when the CPU is idle, to skip
+   over ticks on which nothing is due. */
+static bool one_shot;           /* Channel 0 armed in one-shot mode? */
+static unsigned shot_count;     /* Cycles the one shot was armed for. */
+static int64_t shot_end;        /* Cycle at which the one shot fires. */
+static bool idle_shot;          /* One shot armed by timer_idle_enter()? */
+
+/* Threads blocked in timer_sleep_ns(), soonest deadline first. */
+static struct list hr_sleepers;
+
+/* A thread blocked in timer_sleep_ns(). */
+struct hr_sleeper 
+  {
+    struct list_elem elem;      /* Element in hr_sleepers. */
+    int64_t deadline;           /* Cycle at which to wake up. */
+    struct thread *thread;      /* The sleeping thread. */
+  };
+
+/* Statistics. */
+static int64_t interrupt_cnt;   /* # of timer interrupts. */
+static int64_t skipped_ticks;   /* # of ticks passed without one. */
+
 static intr_handler_func timer_interrupt;
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
 static void real_time_delay (int64_t num, int32_t denom);
+static int64_t now_cycles (void);
+static void arm_one_shot (int64_t when, int64_t now);
+static void advance (int64_t now);
+static void program_next_event (int64_t now);
 
 /* Sets up the timer to interrupt TIMER_FREQ times per second,
    and registers the corresponding interrupt. */
@@ -36,6 +69,7 @@ void
 timer_init (void) 
 {
   pit_configure_channel (0, 2, TIMER_FREQ);
+  list_init (&hr_sleepers);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
 
@@ -84,6 +118,17 @@ timer_elapsed (int64_t then)
   return timer_ticks () - then;
 }
 
+/* Returns the time in PIT cycles (PIT_HZ per second) since boot.
+   Finer than timer_ticks(), for measuring short intervals. */
+int64_t
+timer_cycles (void) 
+{
+  enum intr_level old_level = intr_disable ();
+  int64_t t = now_cycles ();
+  intr_set_level (old_level);
+  return t;
+}
+
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
    be turned on. */
 void
@@ -95,6 +140,106 @@ timer_sleep (int64_t ticks)
   thread_sleep (start + ticks);
 }
 
+/* Orders hr_sleeper elements by deadline. */
+static bool
+hr_sleeper_less (const struct list_elem *a_, const struct list_elem *b_,
+                 void *aux UNUSED)
+{
+  const struct hr_sleeper *a = list_entry (a_, struct hr_sleeper, elem);
+  const struct hr_sleeper *b = list_entry (b_, struct hr_sleeper, elem);
+  return a->deadline < b->deadline;
+}
+
+/* Sleeps for NS nanoseconds, blocking rather than spinning even
+   for sleeps shorter than a timer tick.  Whole ticks are slept on
+   the timer wheel; the remainder is timed by arming the PIT in
+   one-shot mode for the exact deadline, so the wake-up is accurate
+   to a PIT cycle plus interrupt latency rather than to a tick.
+   The deadline is rounded up to a whole PIT cycle, so the sleep
+   never ends early.  Interrupts must be turned on. */
+void
+timer_sleep_ns (int64_t ns) 
+{
+  struct hr_sleeper sleeper;
+  enum intr_level old_level;
+  int64_t deadline;
+
+  ASSERT (intr_get_level () == INTR_ON);
+  if (ns <= 0)
+    return;
+
+  old_level = intr_disable ();
+  /* The current cycle is already partly over, so count one more. */
+  deadline = now_cycles () + 1 + ns / 1000000000 * PIT_HZ
+             + DIV_ROUND_UP (ns % 1000000000 * PIT_HZ, 1000000000);
+  intr_set_level (old_level);
+
+  /* Sleep through the whole ticks before the deadline. */
+  thread_sleep (deadline / TIMER_CYCLES);
+
+  old_level = intr_disable ();
+  if (now_cycles () < deadline) 
+    {
+      sleeper.deadline = deadline;
+      sleeper.thread = thread_current ();
+      list_insert_ordered (&hr_sleepers, &sleeper.elem, hr_sleeper_less, NULL);
+      program_next_event (now_cycles ());
+      thread_block ();
+    }
+  intr_set_level (old_level);
+}
+
+/* Called by the idle thread, with interrupts off, when no thread
+   is ready to run.  Rather than take an interrupt on every tick,
+   arms the PIT to fire when the next sleeping thread is due, up to
+   PIT_COUNT_MAX cycles ahead. */
+void
+timer_idle_enter (void) 
+{
+  int64_t now, next;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  now = now_cycles ();
+  next = thread_next_wakeup (ticks + PIT_COUNT_MAX / TIMER_CYCLES + 1)
+         * TIMER_CYCLES;
+  if (!list_empty (&hr_sleepers)) 
+    {
+      struct hr_sleeper *first = list_entry (list_front (&hr_sleepers),
+                                             struct hr_sleeper, elem);
+      if (first->deadline < next)
+        next = first->deadline;
+    }
+  if (next > now + PIT_COUNT_MAX)
+    next = now + PIT_COUNT_MAX;
+
+  /* Nothing to gain unless at least one tick is skipped. */
+  if (next <= (ticks + 1) * TIMER_CYCLES)
+    return;
+  arm_one_shot (next, now);
+  idle_shot = true;
+}
+
+/* Called by the idle thread, with interrupts off, after an
+   interrupt ended its idle period.  If that was not the timer,
+   catches the tick count up with the time spent idle and rearms
+   the PIT for the next tick boundary, since some thread may now
+   be ready to run and need its time slice. */
+void
+timer_idle_exit (void) 
+{
+  int64_t now;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!idle_shot)
+    return;
+  idle_shot = false;
+  now = now_cycles ();
+  advance (now);
+  program_next_event (now);
+}
+
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
    turned on. */
 void
@@ -163,15 +308,135 @@ void
 timer_print_stats (void) 
 {
   printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
+  printf ("Timer: %"PRId64" interrupts, %"PRId64" ticks skipped while idle\n",
+          interrupt_cnt, skipped_ticks);
 }
 
 /* Timer interrupt handler. */
 static void
 timer_interrupt (struct intr_frame *args UNUSED)
 {
-  ticks++;
-  remove_from_blocked_list (ticks);
-  thread_tick ();
+  int64_t now;
+
+  interrupt_cnt++;
+  if (!one_shot) 
+    {
+      ticks++;
+      remove_from_blocked_list (ticks);
+      thread_tick ();
+      now = ticks * TIMER_CYCLES;
+    }
+  else 
+    {
+      idle_shot = false;
+      now = shot_end;
+      advance (now);
+    }
+  program_next_event (now);
+}
+
+/* Returns the current time in PIT cycles since boot.  Interrupts
+   must be off. */
+static int64_t
+now_cycles (void) 
+{
+  unsigned count = pit_read_count (0);
+
+  if (one_shot)
+    {
+      /* Once the one shot has fired the counter wraps around and
+         keeps going; its interrupt is then pending. */
+      return count <= shot_count ? shot_end - count : shot_end;
+    }
+
+  /* In periodic mode the counter runs from TIMER_CYCLES down to 1
+     over each tick. */
+  if (count == 0 || count > TIMER_CYCLES)
+    count = TIMER_CYCLES;
+  return ticks * TIMER_CYCLES + (TIMER_CYCLES - count);
+}
+
+/* Arms channel 0 to interrupt once, at cycle WHEN, or as soon as
+   possible if WHEN has passed.  NOW is the current cycle.
+   Interrupts must be off. */
+static void
+arm_one_shot (int64_t when, int64_t now) 
+{
+  int64_t delta = when - now;
+
+  if (delta < 1)
+    delta = 1;
+  else if (delta > PIT_COUNT_MAX)
+    delta = PIT_COUNT_MAX;
+  pit_one_shot (0, delta);
+  one_shot = true;
+  shot_count = delta;
+  shot_end = now + delta;
+}
+
+/* Brings the tick count up to cycle NOW, running the per-tick work
+   for every tick boundary passed, and wakes up the sub-tick
+   sleepers that are due.  Interrupts must be off. */
+static void
+advance (int64_t now) 
+{
+  int64_t start = ticks;
+
+  while ((ticks + 1) * TIMER_CYCLES <= now) 
+    {
+      ticks++;
+      thread_tick ();
+    }
+  if (ticks != start) 
+    {
+      skipped_ticks += ticks - start - 1;
+      remove_from_blocked_list (ticks);
+    }
+
+  while (!list_empty (&hr_sleepers)) 
+    {
+      struct hr_sleeper *first = list_entry (list_front (&hr_sleepers),
+                                             struct hr_sleeper, elem);
+      if (first->deadline > now)
+        break;
+      list_pop_front (&hr_sleepers);
+      thread_unblock (first->thread);
+    }
+}
+
+/* Programs channel 0 for the next event after cycle NOW: the next
+   tick boundary, or an earlier sub-tick sleeper's deadline.
+   Periodic mode is restored only on a tick boundary, so that its
+   interrupts stay in phase with the tick count.  Leaves an idle
+   one shot alone.  Interrupts must be off. */
+static void
+program_next_event (int64_t now) 
+{
+  int64_t boundary = (ticks + 1) * TIMER_CYCLES;
+  int64_t next = boundary;
+
+  if (idle_shot)
+    return;
+  if (!list_empty (&hr_sleepers)) 
+    {
+      struct hr_sleeper *first = list_entry (list_front (&hr_sleepers),
+                                             struct hr_sleeper, elem);
+      if (first->deadline < next)
+        next = first->deadline;
+    }
+
+  if (next < boundary)
+    arm_one_shot (next, now);
+  else if (one_shot) 
+    {
+      if (now == ticks * TIMER_CYCLES) 
+        {
+          pit_configure_channel (0, 2, TIMER_FREQ);
+          one_shot = false;
+        }
+      else
+        arm_one_shot (boundary, now);
+    }
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
@@ -229,9 +494,9 @@ real_time_sleep (int64_t num, int32_t denom)
     }
   else 
     {
-      /* Otherwise, use a busy-wait loop for more accurate
+      /* Otherwise, block on a one-shot timer for more accurate
          sub-tick timing. */
-      real_time_delay (num, denom); 
+      timer_sleep_ns (num * (1000000000 / denom));
     }
 }
 
@@ -12,12 +12,18 @@ void timer_calibrate (void);
 
 int64_t timer_ticks (void);
 int64_t timer_elapsed (int64_t);
+int64_t timer_cycles (void);
 
 /* Sleep and yield the CPU to other threads. */
 void timer_sleep (int64_t ticks);
 void timer_msleep (int64_t milliseconds);
 void timer_usleep (int64_t microseconds);
 void timer_nsleep (int64_t nanoseconds);
+void timer_sleep_ns (int64_t nanoseconds);
+
+/* Tickless idle. */
+void timer_idle_enter (void);
+void timer_idle_exit (void);
 
 /* Busy waits. */
 void timer_mdelay (int64_t milliseconds);
@@ -124,12 +124,12 @@ dir_lookup (const struct dir *dir, const char *name,
   ASSERT (name != NULL);
 
   dir_inode = (struct inode *) dir_get_inode (dir);
-  lock_acquire (&dir_inode->inode_lock);
+  rwlock_acquire_read (&dir_inode->inode_lock);
   if (lookup (dir, name, &e, NULL))
     *inode = inode_open (e.inode_sector);
   else
     *inode = NULL;
-  lock_release (&dir_inode->inode_lock);
+  rwlock_release_read (&dir_inode->inode_lock);
 
   return *inode != NULL;
 }
@@ -152,7 +152,7 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   ASSERT (name != NULL);
 
   dir_inode = (struct inode *) dir_get_inode(dir);
-  lock_acquire (&dir_inode->inode_lock);
+  rwlock_acquire_write (&dir_inode->inode_lock);
 
   /* Check NAME for validity and
      Check that NAME is not in use. */
@@ -187,7 +187,7 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 
  done:
-  lock_release (&dir_inode->inode_lock);
+  rwlock_release_write (&dir_inode->inode_lock);
   return success;
 }
 
@@ -220,7 +220,7 @@ dir_remove (struct dir *dir, const char *name)
   ASSERT (name != NULL);
 
   dir_inode = dir_get_inode(dir);
-  lock_acquire (&dir_inode->inode_lock);
+  rwlock_acquire_write (&dir_inode->inode_lock);
 
   /* Find directory entry. */
   if (!lookup (dir, name, &e, &ofs))
@@ -244,7 +244,7 @@ dir_remove (struct dir *dir, const char *name)
 
  done:
   inode_close (inode);
-  lock_release (&dir_inode->inode_lock);
+  rwlock_release_write (&dir_inode->inode_lock);
   return success;
 }
 
@@ -256,7 +256,7 @@ dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
   struct dir_entry e;
   struct inode *dir_inode = (struct inode *) dir_get_inode(dir);
-  lock_acquire (&dir_inode->inode_lock);
+  rwlock_acquire_read (&dir_inode->inode_lock);
 
   while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
     {
@@ -264,11 +264,11 @@ dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
       if (e.in_use)
         {
           strlcpy (name, e.name, NAME_MAX + 1);
-          lock_release (&dir_inode->inode_lock);
+          rwlock_release_read (&dir_inode->inode_lock);
           return true;
         } 
     }
-  lock_release (&dir_inode->inode_lock);
+  rwlock_release_read (&dir_inode->inode_lock);
   return false;
 }
 
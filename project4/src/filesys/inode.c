@@ -147,7 +147,7 @@ inode_open (block_sector_t sector)
 	inode->open_cnt = 1;
 	inode->deny_write_cnt = 0;
 	inode->removed = false;
-	lock_init (&inode->inode_lock);
+	rwlock_init (&inode->inode_lock);
 
 	block_read (fs_device, inode->sector, &disk_inode);
 	inode->data_length = disk_inode.length;
@@ -238,6 +238,12 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 		return bytes_read;
 	}
 
+	/* Readers of a file share its lock so they only exclude growth.
+	   Directory reads are covered by the caller's hold. */
+	if (inode->isdir == false) {
+		rwlock_acquire_read (&inode->inode_lock);
+	}
+
 	while (size > 0)
 	{
 		/* Disk sector to read, starting byte offset within sector. */
@@ -266,6 +272,9 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 		bytes_read += chunk_size;
 	}
 
+	if (inode->isdir == false) {
+		rwlock_release_read (&inode->inode_lock);
+	}
 	return bytes_read;
 }
 
@@ -285,13 +294,17 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 	if (inode->deny_write_cnt)
 		return 0;
 
+	/* Directories are grown under the directory's own exclusive
+	   hold, taken by dir_add(). */
 	if (offset + size > inode_length (inode)) {
 		if (inode->isdir == false) {
-			lock_acquire (&inode->inode_lock);
+			rwlock_acquire_write (&inode->inode_lock);
 		}
-		inode_grow (inode, offset + size);
+		/* Another writer may have grown the file while we waited. */
+		if (offset + size > inode_length (inode))
+			inode_grow (inode, offset + size);
 		if (inode->isdir == false) {
-			lock_release (&inode->inode_lock);
+			rwlock_release_write (&inode->inode_lock);
 		}
 	}
 
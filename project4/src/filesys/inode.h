@@ -58,7 +58,9 @@ struct inode
 	size_t doubly_indir_index;
 	bool isdir;
 	block_sector_t parent;
-	struct lock inode_lock;
+	struct rwlock inode_lock;           /* Shared for reads and lookups,
+	                                       exclusive for growth and
+	                                       directory updates. */
 
 };
 
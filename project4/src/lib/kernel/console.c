@@ -1,6 +1,7 @@
 #include <console.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 #include "devices/serial.h"
 #include "devices/vga.h"
 #include "threads/init.h"
@@ -8,7 +9,7 @@
 #include "threads/synch.h"
 
 static void vprintf_helper (char, void *);
-static void putchar_have_lock (uint8_t c);
+static void putbuf_have_lock (const char *buffer, size_t n);
 
 /* The console lock.
    Both the vga and serial layers do their own locking, so it's
@@ -59,6 +60,20 @@ static int console_lock_depth;
 /* Number of characters written to console. */
 static int64_t write_cnt;
 
+/* vprintf() formats into a buffer of this many bytes on the
+   stack, without the console lock, and writes out each full
+   buffer as a single chunk. */
+#define PRINTF_BUF_SIZE 128
+
+/* Auxiliary data for vprintf_helper(). */
+struct vprintf_aux 
+  {
+    char buf[PRINTF_BUF_SIZE];  /* Formatted, not yet written. */
+    size_t len;                 /* Bytes in BUF. */
+    int char_cnt;               /* Characters formatted so far. */
+    bool locked;                /* Console acquired for this call? */
+  };
+
 /* Enable console locking. */
 void
 console_init (void) 
@@ -121,17 +136,26 @@ console_locked_by_current_thread (void)
 
 /* The standard vprintf() function,
    which is like printf() but uses a va_list.
-   Writes its output to both vga display and serial port. */
+   Writes its output to both vga display and serial port.
+   Formatting happens before the console lock is taken; output
+   longer than one buffer holds the lock from the first chunk
+   to the last, so it is not mixed with other threads'. */
 int
 vprintf (const char *format, va_list args) 
 {
-  int char_cnt = 0;
+  struct vprintf_aux aux;
 
-  acquire_console ();
-  __vprintf (format, args, vprintf_helper, &char_cnt);
+  aux.len = 0;
+  aux.char_cnt = 0;
+  aux.locked = false;
+  __vprintf (format, args, vprintf_helper, &aux);
+
+  if (!aux.locked)
+    acquire_console ();
+  putbuf_have_lock (aux.buf, aux.len);
   release_console ();
 
-  return char_cnt;
+  return aux.char_cnt;
 }
 
 /* Writes string S to the console, followed by a new-line
@@ -140,9 +164,8 @@ int
 puts (const char *s) 
 {
   acquire_console ();
-  while (*s != '\0')
-    putchar_have_lock (*s++);
-  putchar_have_lock ('\n');
+  putbuf_have_lock (s, strlen (s));
+  putbuf_have_lock ("\n", 1);
   release_console ();
 
   return 0;
@@ -153,8 +176,7 @@ void
 putbuf (const char *buffer, size_t n) 
 {
   acquire_console ();
-  while (n-- > 0)
-    putchar_have_lock (*buffer++);
+  putbuf_have_lock (buffer, n);
   release_console ();
 }
 
@@ -162,8 +184,10 @@ putbuf (const char *buffer, size_t n)
 int
 putchar (int c) 
 {
+  char ch = c;
+
   acquire_console ();
-  putchar_have_lock (c);
+  putbuf_have_lock (&ch, 1);
   release_console ();
   
   return c;
@@ -171,21 +195,35 @@ putchar (int c)
 
 /* Helper function for vprintf(). */
 static void
-vprintf_helper (char c, void *char_cnt_) 
+vprintf_helper (char c, void *aux_) 
 {
-  int *char_cnt = char_cnt_;
-  (*char_cnt)++;
-  putchar_have_lock (c);
+  struct vprintf_aux *aux = aux_;
+
+  aux->char_cnt++;
+  aux->buf[aux->len++] = c;
+  if (aux->len == sizeof aux->buf) 
+    {
+      if (!aux->locked) 
+        {
+          acquire_console ();
+          aux->locked = true;
+        }
+      putbuf_have_lock (aux->buf, aux->len);
+      aux->len = 0;
+    }
 }
 
-/* Writes C to the vga display and serial port.
+/* Writes the N characters in BUFFER to the vga display and
+   serial port, each as one chunk.
    The caller has already acquired the console lock if
    appropriate. */
 static void
-putchar_have_lock (uint8_t c) 
+putbuf_have_lock (const char *buffer, size_t n) 
 {
   ASSERT (console_locked_by_current_thread ());
-  write_cnt++;
-  serial_putc (c);
-  vga_putc (c);
+  if (n == 0)
+    return;
+  write_cnt += n;
+  serial_putbuf ((const uint8_t *) buffer, n);
+  vga_putbuf (buffer, n);
 }
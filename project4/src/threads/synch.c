@@ -27,8 +27,10 @@
 */
 
 #include "threads/synch.h"
+#include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 
@@ -157,6 +159,86 @@ sema_test_helper (void *sema_)
     }
 }
 
+/* If true, record lock statistics. */
+bool lockstat_enabled;
+
+/* Statistics for each lock_init() call site.  Locks embedded in
+   objects that come and go (inodes, files) share one entry, so
+   the table never points into freed memory. */
+#define LOCK_STAT_CNT 64
+static struct lock_stat lock_stats[LOCK_STAT_CNT];
+static size_t lock_stat_cnt;
+
+/* Returns the statistics entry for locks named NAME, creating it
+   if necessary, or a null pointer if the table is full. */
+static struct lock_stat *
+lock_stat_lookup (const char *name)
+{
+  struct lock_stat *st = NULL;
+  enum intr_level old_level;
+  size_t i;
+
+  old_level = intr_disable ();
+  for (i = 0; i < lock_stat_cnt; i++)
+    if (!strcmp (lock_stats[i].name, name))
+      {
+        st = &lock_stats[i];
+        break;
+      }
+  if (st == NULL && lock_stat_cnt < LOCK_STAT_CNT)
+    {
+      st = &lock_stats[lock_stat_cnt++];
+      st->name = name;
+    }
+  intr_set_level (old_level);
+  return st;
+}
+
+/* Records that the current thread acquired LOCK after waiting
+   from tick START, CONTENDED telling whether it had to block. */
+static void
+lock_stat_acquired (struct lock *lock, bool contended, int64_t start)
+{
+  struct lock_stat *st = lock->stat;
+  enum intr_level old_level;
+  int64_t now;
+
+  if (st == NULL)
+    return;
+  now = timer_ticks ();
+  lock->acquire_time = now;
+
+  old_level = intr_disable ();
+  st->acquire_cnt++;
+  if (contended)
+    {
+      int64_t wait = now - start;
+      st->contend_cnt++;
+      st->total_wait += wait;
+      if (wait > st->max_wait)
+        st->max_wait = wait;
+    }
+  intr_set_level (old_level);
+}
+
+/* Records that LOCK's holder is about to release it. */
+static void
+lock_stat_released (struct lock *lock)
+{
+  struct lock_stat *st = lock->stat;
+  enum intr_level old_level;
+  int64_t hold;
+
+  if (st == NULL)
+    return;
+  hold = timer_ticks () - lock->acquire_time;
+
+  old_level = intr_disable ();
+  if (hold > st->max_hold)
+    st->max_hold = hold;
+  intr_set_level (old_level);
+}
+
 /* Initializes LOCK.  A lock can be held by at most a single
    thread at any given time.  Our locks are not "recursive", that
    is, it is an error for the thread currently holding a lock to
@@ -171,14 +253,21 @@ sema_test_helper (void *sema_)
    another one "up" it, but with a lock the same thread must both
    acquire and release it.  When these restrictions prove
    onerous, it's a good sign that a semaphore should be used,
-   instead of a lock. */
+   instead of a lock.
+
+   NAME groups the lock with others of the same name in the
+   -lockstat table; the lock_init() macro passes the "FILE:LINE"
+   of its call site. */
 void
-lock_init (struct lock *lock)
+lock_init_named (struct lock *lock, const char *name)
 {
   ASSERT (lock != NULL);
+  ASSERT (name != NULL);
 
   lock->holder = NULL;
   sema_init (&lock->semaphore, 1);
+  lock->stat = lockstat_enabled ? lock_stat_lookup (name) : NULL;
+  lock->acquire_time = 0;
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
@@ -196,7 +285,15 @@ lock_acquire (struct lock *lock)
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
 
-  sema_down (&lock->semaphore);
+  if (lock->stat != NULL)
+    {
+      int64_t start = timer_ticks ();
+      bool contended = lock->semaphore.value == 0;
+      sema_down (&lock->semaphore);
+      lock_stat_acquired (lock, contended, start);
+    }
+  else
+    sema_down (&lock->semaphore);
   lock->holder = thread_current ();
   list_push_back (&thread_current ()->lock_list, &lock->lock_elem);
 }
@@ -218,6 +315,7 @@ lock_try_acquire (struct lock *lock)
   success = sema_try_down (&lock->semaphore);
   if (success) {
 	  lock->holder = thread_current ();
+	  lock_stat_acquired (lock, false, 0);
 	  list_push_back (&thread_current ()->lock_list, &lock->lock_elem);
   }
 //  lock->holder = thread_current ();
@@ -235,6 +333,7 @@ lock_release (struct lock *lock)
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
+  lock_stat_released (lock);
   lock->holder = NULL;
   list_remove (&lock->lock_elem);
   sema_up (&lock->semaphore);
@@ -250,6 +349,42 @@ lock_held_by_current_thread (const struct lock *lock)
 
   return lock->holder == thread_current ();
 }
+
+/* Prints the lock statistics table, worst total wait first.
+   Does nothing unless -lockstat was given. */
+void
+lock_print_stats (void)
+{
+  struct lock_stat *sorted[LOCK_STAT_CNT];
+  size_t i, j;
+
+  if (!lockstat_enabled)
+    return;
+
+  for (i = 0; i < lock_stat_cnt; i++)
+    {
+      struct lock_stat *st = &lock_stats[i];
+      for (j = i; j > 0 && (sorted[j - 1]->total_wait < st->total_wait
+                            || (sorted[j - 1]->total_wait == st->total_wait
+                                && sorted[j - 1]->contend_cnt < st->contend_cnt));
+           j--)
+        sorted[j] = sorted[j - 1];
+      sorted[j] = st;
+    }
+
+  printf ("Locks: %-26s %10s %10s %8s %10s %8s\n", "(ticks)",
+          "acquired", "contended", "max wait", "total wait", "max hold");
+  for (i = 0; i < lock_stat_cnt; i++)
+    {
+      struct lock_stat *st = sorted[i];
+      const char *name = st->name;
+      while (name[0] == '.' && name[1] == '.' && name[2] == '/')
+        name += 3;
+      printf ("       %-26.26s %10llu %10llu %8"PRId64" %10"PRId64" %8"PRId64"\n",
+              name, st->acquire_cnt, st->contend_cnt, st->max_wait,
+              st->total_wait, st->max_hold);
+    }
+}
 
 /* One semaphore in a list. */
 struct semaphore_elem 
@@ -341,3 +476,95 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   while (!list_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
+
+/* Initializes RW as an unheld readers-writer lock.  NAME is
+   used for RW's internal lock in the -lockstat table. */
+void
+rwlock_init_named (struct rwlock *rw, const char *name)
+{
+  ASSERT (rw != NULL);
+
+  lock_init_named (&rw->lock, name);
+  cond_init (&rw->readers_ok);
+  cond_init (&rw->writers_ok);
+  rw->readers = 0;
+  rw->waiting_writers = 0;
+  rw->writer = NULL;
+}
+
+/* Acquires RW for reading, sleeping while a writer holds it or
+   is waiting for it.  A thread must not acquire RW for reading
+   while it already holds RW in either mode. */
+void
+rwlock_acquire_read (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+
+  lock_acquire (&rw->lock);
+  ASSERT (rw->writer != thread_current ());
+  while (rw->writer != NULL || rw->waiting_writers > 0)
+    cond_wait (&rw->readers_ok, &rw->lock);
+  rw->readers++;
+  lock_release (&rw->lock);
+}
+
+/* Releases a read hold on RW, handing it to a waiting writer if
+   this was the last reader. */
+void
+rwlock_release_read (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_acquire (&rw->lock);
+  ASSERT (rw->readers > 0);
+  if (--rw->readers == 0 && rw->waiting_writers > 0)
+    cond_signal (&rw->writers_ok, &rw->lock);
+  lock_release (&rw->lock);
+}
+
+/* Acquires RW for writing, sleeping until there are no readers
+   and no other writer. */
+void
+rwlock_acquire_write (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+
+  lock_acquire (&rw->lock);
+  ASSERT (rw->writer != thread_current ());
+  rw->waiting_writers++;
+  while (rw->writer != NULL || rw->readers > 0)
+    cond_wait (&rw->writers_ok, &rw->lock);
+  rw->waiting_writers--;
+  rw->writer = thread_current ();
+  lock_release (&rw->lock);
+}
+
+/* Releases RW, which must be held for writing by the current
+   thread.  Another waiting writer goes next; otherwise all
+   waiting readers are let in together. */
+void
+rwlock_release_write (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_acquire (&rw->lock);
+  ASSERT (rw->writer == thread_current ());
+  rw->writer = NULL;
+  if (rw->waiting_writers > 0)
+    cond_signal (&rw->writers_ok, &rw->lock);
+  else
+    cond_broadcast (&rw->readers_ok, &rw->lock);
+  lock_release (&rw->lock);
+}
+
+/* Returns true if the current thread holds RW for writing.
+   (Read holds are not tracked per thread.) */
+bool
+rwlock_held_by_current_thread (const struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  return rw->writer == thread_current ();
+}
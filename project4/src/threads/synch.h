@@ -3,6 +3,7 @@
 
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 /* A counting semaphore. */
 struct semaphore 
@@ -17,19 +18,44 @@ bool sema_try_down (struct semaphore *);
 void sema_up (struct semaphore *);
 void sema_self_test (void);
 
+/* Contention statistics shared by every lock initialized at one
+   lock_init() call site.  Collected only under -lockstat. */
+struct lock_stat
+  {
+    const char *name;           /* "FILE:LINE" of lock_init(). */
+    unsigned long long acquire_cnt;   /* Acquisitions. */
+    unsigned long long contend_cnt;   /* Acquisitions that had to wait. */
+    int64_t total_wait;         /* Ticks spent waiting, in total. */
+    int64_t max_wait;           /* Longest single wait, in ticks. */
+    int64_t max_hold;           /* Longest single hold, in ticks. */
+  };
+
+/* If true, record lock statistics.  Set by kernel command-line
+   option "-lockstat". */
+extern bool lockstat_enabled;
+
 /* Lock. */
 struct lock 
   {
     struct thread *holder;      /* Thread holding lock (for debugging). */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
+    struct lock_stat *stat;     /* Statistics, if -lockstat was given. */
+    int64_t acquire_time;       /* Tick at which holder acquired it. */
     struct list_elem lock_elem;
   };
 
-void lock_init (struct lock *);
+/* String literal "FILE:LINE" for the place it is expanded. */
+#define LOCK_SITE_STR(LINE) #LINE
+#define LOCK_SITE_LINE(LINE) LOCK_SITE_STR (LINE)
+#define LOCK_SITE __FILE__ ":" LOCK_SITE_LINE (__LINE__)
+
+void lock_init_named (struct lock *, const char *name);
+#define lock_init(LOCK) lock_init_named (LOCK, LOCK_SITE)
 void lock_acquire (struct lock *);
 bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
+void lock_print_stats (void);
 
 /* Condition variable. */
 struct condition 
@@ -42,6 +68,28 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Readers-writer lock.  Any number of readers may hold it at
+   once, or a single writer.  Waiting writers are preferred over
+   newly arriving readers so that a steady stream of lookups
+   cannot starve an update. */
+struct rwlock
+  {
+    struct lock lock;           /* Protects the fields below. */
+    struct condition readers_ok;/* Signaled when readers may enter. */
+    struct condition writers_ok;/* Signaled when a writer may enter. */
+    unsigned readers;           /* Number of active readers. */
+    unsigned waiting_writers;   /* Number of blocked writers. */
+    struct thread *writer;      /* Active writer, if any. */
+  };
+
+void rwlock_init_named (struct rwlock *, const char *name);
+#define rwlock_init(RW) rwlock_init_named (RW, LOCK_SITE)
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+bool rwlock_held_by_current_thread (const struct rwlock *);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
@@ -2,16 +2,20 @@
 #include <debug.h>
 #include <stddef.h>
 #include <random.h>
+#include <round.h>
 #include <stdio.h>
 #include <string.h>
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
+#include "threads/loader.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
+#include "devices/pit.h"
+#include "devices/timer.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/syscall.h"
@@ -27,14 +31,30 @@
    that are ready to run but not actually running. */
 static struct list ready_list;
 
-/* Used for timer_sleep. Contains a sorted list of threads
-   that are in sleeping state based on their wake_up_time. */
-static struct list blocked_list;
+/* Used for timer_sleep.  A hashed timing wheel: a thread sleeping
+   until tick T waits in slot T % TIMER_WHEEL_SIZE, so putting a
+   thread to sleep or taking it off the wheel is O(1), and a tick
+   only looks at the sleepers in its own slot.  A sleeper due more
+   than one revolution ahead stays put until its round comes up. */
+#define TIMER_WHEEL_SIZE 256            /* Must be a power of 2. */
+static struct list timer_wheel[TIMER_WHEEL_SIZE];
+static int64_t timer_wheel_now;         /* Last tick expired. */
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
 static struct list all_list;
 
+/* Threads hashed by tid, so that retrieve_thread() need not scan
+   all_list.  Tids are handed out in sequence, so their low bits
+   spread them evenly.  Every thread takes a page of memory, so
+   there cannot be more threads than pages; the table has at least
+   one bucket per page of RAM, and a lookup examines about one
+   thread.  It is allocated by thread_start().  A thread is in the
+   table from the time its tid is assigned until it exits; like
+   all_list, the table is only touched with interrupts off. */
+static struct list *tid_table;
+static size_t tid_table_size;           /* A power of 2. */
+
 /* Idle thread. */
 static struct thread *idle_thread;
 
@@ -63,6 +83,18 @@ static long long user_ticks;    /* # of timer ticks in user programs. */
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
 static unsigned thread_ticks;   /* # of timer ticks since last yield. */
+static bool slice_expired;      /* Is the running thread being preempted? */
+
+/* Wakeup-to-run latency histogram: one row per band of
+   PRI_BAND_SIZE priorities, bucket B counting latencies below
+   2**B microseconds (and at least 2**(B-1) for B > 0). */
+#define PRI_BAND_SIZE 16
+#define PRI_BAND_CNT ((PRI_MAX + 1) / PRI_BAND_SIZE)
+#define LATENCY_BUCKETS 24
+static unsigned wakeup_latency[PRI_BAND_CNT][LATENCY_BUCKETS];
+
+/* Largest number of threads listed by thread_print_sched_stats(). */
+#define SCHED_STAT_THREADS 16
 
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
@@ -80,6 +112,7 @@ static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
+static void tid_table_insert (struct thread *);
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
@@ -97,12 +130,16 @@ static tid_t allocate_tid (void);
 void
 thread_init (void) 
 {
+	int i;
+
 	ASSERT (intr_get_level () == INTR_OFF);
 
 	lock_init (&tid_lock);
 	list_init (&ready_list);
 	list_init (&all_list);
-	list_init (&blocked_list);
+	for (i = 0; i < TIMER_WHEEL_SIZE; i++)
+		list_init (&timer_wheel[i]);
+	timer_wheel_now = 0;
 
 	/* Set up a thread structure for the running thread. */
 	initial_thread = running_thread ();
@@ -112,10 +149,22 @@ thread_init (void)
 }
 
 /* Starts preemptive thread scheduling by enabling interrupts.
-   Also creates the idle thread. */
+   Also allocates the tid table and creates the idle thread. */
 void
 thread_start (void) 
 {
+	size_t i;
+
+	/* Allocate the tid table and enter the running thread. */
+	tid_table_size = 1;
+	while (tid_table_size < init_ram_pages)
+		tid_table_size *= 2;
+	tid_table = palloc_get_multiple (PAL_ASSERT,
+			DIV_ROUND_UP (tid_table_size * sizeof *tid_table, PGSIZE));
+	for (i = 0; i < tid_table_size; i++)
+		list_init (&tid_table[i]);
+	tid_table_insert (initial_thread);
+
 	/* Create the idle thread. */
 	struct semaphore idle_started;
 	sema_init (&idle_started, 0);
@@ -144,10 +193,15 @@ thread_tick (void)
 #endif
 	else
 		kernel_ticks++;
+	t->run_ticks++;
 
-	/* Enforce preemption. */
-	if (++thread_ticks >= TIME_SLICE)
+	/* Enforce preemption.  Outside interrupt context this is the
+	   idle thread catching up on ticks it slept through (see
+	   timer_idle_exit()), which gives up the CPU right after. */
+	if (++thread_ticks >= TIME_SLICE && intr_context ()) {
+		slice_expired = true;
 		intr_yield_on_return ();
+	}
 }
 
 /* Prints thread statistics. */
@@ -156,6 +210,100 @@ thread_print_stats (void)
 {
 	printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
 			idle_ticks, kernel_ticks, user_ticks);
+	thread_print_sched_stats ();
+}
+
+/* Converts a cycle count from timer_cycles() to microseconds. */
+static int64_t
+cycles_to_us (int64_t cycles)
+{
+	return cycles * 1000000 / PIT_HZ;
+}
+
+/* Prints run time, context switches and run queue wait for up to
+   SCHED_STAT_THREADS live threads, then the wakeup latency
+   histogram for each priority band that has samples. */
+void
+thread_print_sched_stats (void)
+{
+	struct {
+		tid_t tid;
+		char name[16];
+		int64_t run_ticks;
+		unsigned vol, invol;
+		int64_t ready_cycles;
+	} snap[SCHED_STAT_THREADS];
+	enum intr_level old_level;
+	struct list_elem *e;
+	size_t cnt = 0, total = 0, i;
+	int band, b;
+
+	/* Copy the thread list out first: printing may block on the
+	   console lock, and threads may exit meanwhile. */
+	old_level = intr_disable ();
+	for (e = list_begin (&all_list); e != list_end (&all_list);
+			e = list_next (e)) {
+		struct thread *t = list_entry (e, struct thread, allelem);
+		total++;
+		if (cnt < SCHED_STAT_THREADS) {
+			snap[cnt].tid = t->tid;
+			strlcpy (snap[cnt].name, t->name, sizeof snap[cnt].name);
+			snap[cnt].run_ticks = t->run_ticks;
+			snap[cnt].vol = t->vol_switches;
+			snap[cnt].invol = t->invol_switches;
+			snap[cnt].ready_cycles = t->ready_cycles;
+			cnt++;
+		}
+	}
+	intr_set_level (old_level);
+
+	printf ("Sched: %5s %-16s %8s %8s %8s %12s\n", "tid", "name",
+			"ticks", "vol", "invol", "ready us");
+	for (i = 0; i < cnt; i++)
+		printf ("       %5d %-16s %8lld %8u %8u %12lld\n", snap[i].tid,
+				snap[i].name, snap[i].run_ticks, snap[i].vol, snap[i].invol,
+				cycles_to_us (snap[i].ready_cycles));
+	if (total > cnt)
+		printf ("       (%zu more threads)\n", total - cnt);
+
+	for (band = 0; band < PRI_BAND_CNT; band++) {
+		bool any = false;
+		for (b = 0; b < LATENCY_BUCKETS; b++)
+			if (wakeup_latency[band][b] != 0) {
+				if (!any)
+					printf ("Wakeup latency, priority %d-%d:", band * PRI_BAND_SIZE,
+							(band + 1) * PRI_BAND_SIZE - 1);
+				any = true;
+				printf (" <%luus:%u", 1ul << b, wakeup_latency[band][b]);
+			}
+		if (any)
+			printf ("\n");
+	}
+}
+
+/* Records that the running thread CUR has just come off the run
+   queue, crediting its wait to CUR and, if it was woken rather
+   than preempted, to the latency histogram. */
+static void
+account_ready_wait (struct thread *cur)
+{
+	int64_t wait, us;
+	int b;
+
+	if (cur == idle_thread || cur->ready_since == 0)
+		return;
+	wait = timer_cycles () - cur->ready_since;
+	if (wait < 0)
+		wait = 0;
+	cur->ready_cycles += wait;
+	cur->ready_since = 0;
+
+	if (cur->woken) {
+		us = cycles_to_us (wait);
+		for (b = 0; b < LATENCY_BUCKETS - 1 && us >= (1ll << b); b++)
+			continue;
+		wakeup_latency[cur->priority / PRI_BAND_SIZE][b]++;
+	}
 }
 
 static struct
@@ -210,6 +358,7 @@ thread_create (const char *name, int priority,
 	/* Initialize thread. */
 	init_thread (t, name, priority);
 	tid = t->tid = allocate_tid ();
+	tid_table_insert (t);
 
 	/* Stack frame for kernel_thread(). */
 	kf = alloc_frame (t, sizeof *kf);
@@ -239,33 +388,20 @@ thread_create (const char *name, int priority,
 	return tid;
 }
 
-/* Compare two thread elements based on their wake_up_time.
-   Returns true if thread1's wake_up_time is smaller than
-   thread2's wake_up_time */
-static bool
-compare_ticks (const struct list_elem *a,
-		const struct list_elem *b,
-		void *aux UNUSED)
-{
-	struct thread *threadA = list_entry (a, struct thread, blocked_elem);
-	struct thread *threadB = list_entry (b, struct thread, blocked_elem);
-	return (threadA->wake_up_time < threadB->wake_up_time);
-}
-
-/* Thread sleeps (blocked) until wake_time. Then inserts
-   current thread into blocked_list in order sorted by
-   wake_time. */
+/* Thread sleeps (blocked) until wake_time.  The current
+   thread is put on the timer wheel slot for wake_time; it
+   returns at once if that tick has already been expired. */
 void
 thread_sleep (const int64_t wake_time)
 {
 	enum intr_level old_level;
 	old_level = intr_disable ();
-	thread_current ()->wake_up_time = wake_time;
-	list_insert_ordered (&blocked_list,
-			&thread_current ()->blocked_elem,
-			(list_less_func *) &compare_ticks,
-			NULL);
-	thread_block ();
+	if (wake_time > timer_wheel_now) {
+		thread_current ()->wake_up_time = wake_time;
+		list_push_back (&timer_wheel[wake_time & (TIMER_WHEEL_SIZE - 1)],
+				&thread_current ()->blocked_elem);
+		thread_block ();
+	}
 	intr_set_level (old_level);
 }
 
@@ -304,28 +440,65 @@ thread_unblock (struct thread *t)
 	ASSERT (t->status == THREAD_BLOCKED);
 	list_push_back (&ready_list, &t->elem);
 	t->status = THREAD_READY;
+	t->ready_since = timer_cycles ();
+	t->woken = true;
 	intr_set_level (old_level);
 }
 
-/* If current time greater than or equal to thread's
-   wake_up_time then remove the thread from the blocked_list
-   and unblock it. */
+/* Wakes up every sleeping thread whose wake_up_time is at or
+   before current_time.  Each slot passed since the last call is
+   expired in turn; after a gap of a full revolution or more,
+   every slot is looked at exactly once. */
 void
 remove_from_blocked_list (int64_t current_time)
 {
-	if (!list_empty (&blocked_list)) {
+	int64_t tick = timer_wheel_now;
+
+	if (current_time - tick > TIMER_WHEEL_SIZE)
+		tick = current_time - TIMER_WHEEL_SIZE;
+	while (tick < current_time) {
+		struct list *slot;
 		struct list_elem *e;
-		for (e = list_begin (&blocked_list);
-				e != list_end (&blocked_list);
-				e = list_next (e)) {
+
+		tick++;
+		slot = &timer_wheel[tick & (TIMER_WHEEL_SIZE - 1)];
+		for (e = list_begin (slot); e != list_end (slot);) {
 			struct thread *blocked_thread =
 					list_entry (e, struct thread, blocked_elem);
 			if (current_time >= blocked_thread->wake_up_time) {
-				list_remove (&blocked_thread->blocked_elem);
+				e = list_remove (e);
 				thread_unblock (blocked_thread);
+			} else {
+				e = list_next (e);
 			}
 		}
 	}
+	if (current_time > timer_wheel_now)
+		timer_wheel_now = current_time;
+}
+
+/* Returns the earliest tick after the last one expired at which
+   a sleeping thread is due, or LIMIT if none is due before it.
+   Looks at one timer wheel slot per tick.  Interrupts must be
+   off. */
+int64_t
+thread_next_wakeup (int64_t limit)
+{
+	int64_t tick;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	for (tick = timer_wheel_now + 1;
+			tick < limit && tick - timer_wheel_now <= TIMER_WHEEL_SIZE;
+			tick++) {
+		struct list *slot = &timer_wheel[tick & (TIMER_WHEEL_SIZE - 1)];
+		struct list_elem *e;
+		for (e = list_begin (slot); e != list_end (slot); e = list_next (e)) {
+			if (list_entry (e, struct thread, blocked_elem)->wake_up_time <= tick)
+				return tick;
+		}
+	}
+	return limit;
 }
 
 /* Returns the name of the running thread. */
@@ -377,6 +550,7 @@ thread_exit (void)
      when it calls thread_schedule_tail(). */
 	intr_disable ();
 	list_remove (&thread_current()->allelem);
+	list_remove (&thread_current ()->tidelem);
 	thread_current ()->status = THREAD_DYING;
 	schedule ();
 	NOT_REACHED ();
@@ -393,8 +567,11 @@ thread_yield (void)
 	ASSERT (!intr_context ());
 
 	old_level = intr_disable ();
-	if (cur != idle_thread)
+	if (cur != idle_thread) {
 		list_push_back (&ready_list, &cur->elem);
+		cur->ready_since = timer_cycles ();
+		cur->woken = false;
+	}
 	cur->status = THREAD_READY;
 	schedule ();
 	intr_set_level (old_level);
@@ -482,8 +659,13 @@ idle (void *idle_started_ UNUSED)
 	{
 		/* Let someone else run. */
 		intr_disable ();
+		timer_idle_exit ();
 		thread_block ();
 
+		/* Nothing else is ready: stop the periodic tick until the
+		   next sleeping thread is due. */
+		timer_idle_enter ();
+
 		/* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -552,9 +734,8 @@ init_thread (struct thread *t, const char *name, int priority)
 	lock_init(&t->wait_lock);
 	lock_init(&t->load_lock);
 
-	list_init (&t->opened_file_list);
+	t->fd_table = NULL; // created by the first open().
 	list_init (&t->lock_list);
-	t->fd = 2; // minimum fd value to start from.
 	t->exec_file = NULL;
  	list_init (&t->child_list);
 	t->parent = -1;
@@ -616,6 +797,7 @@ thread_schedule_tail (struct thread *prev)
 
 	/* Start new time slice. */
 	thread_ticks = 0;
+	account_ready_wait (cur);
 
 #ifdef USERPROG
 	/* Activate the new address space. */
@@ -652,8 +834,14 @@ schedule (void)
 	ASSERT (cur->status != THREAD_RUNNING);
 	ASSERT (is_thread (next));
 
-	if (cur != next)
+	if (cur != next) {
+		if (cur->status == THREAD_READY && slice_expired)
+			cur->invol_switches++;
+		else
+			cur->vol_switches++;
 		prev = switch_threads (cur, next);
+	}
+	slice_expired = false;
 	thread_schedule_tail (prev);
 }
 
@@ -675,22 +863,37 @@ allocate_tid (void)
    Used by switch.S, which can't figure it out on its own. */
 uint32_t thread_stack_ofs = offsetof (struct thread, stack);
 
+/* Adds T, whose tid has just been assigned, to the tid table. */
+static void
+tid_table_insert (struct thread *t)
+{
+	enum intr_level old_level = intr_disable ();
+	list_push_back (&tid_table[t->tid & (tid_table_size - 1)], &t->tidelem);
+	intr_set_level (old_level);
+}
+
 /*
- * Given a pid, return the corresponding thread from all_list.
+ * Given a pid, return the corresponding thread, or NULL if no
+ * live thread has it.  Looks in the tid table; all_list is only
+ * walked for diagnostics.
  */
 struct thread*
 retrieve_thread (int pid)
 {
+	struct list *bucket = &tid_table[pid & (tid_table_size - 1)];
+	struct thread *found = NULL;
 	struct list_elem *e;
-	for (e = list_begin (&all_list);
-			e != list_end (&all_list);
-			e = list_next (e)) {
-		struct thread *t = list_entry (e, struct thread, allelem);
+	enum intr_level old_level = intr_disable ();
+
+	for (e = list_begin (bucket); e != list_end (bucket); e = list_next (e)) {
+		struct thread *t = list_entry (e, struct thread, tidelem);
 		if (t->tid == pid) {
-			return t;
+			found = t;
+			break;
 		}
 	}
-	return NULL;
+	intr_set_level (old_level);
+	return found;
 }
 
 /*
@@ -90,6 +90,7 @@ struct thread
 	uint8_t *stack;                     /* Saved stack pointer. */
 	int priority;                       /* Priority. */
 	struct list_elem allelem;           /* List element for all threads list. */
+	struct list_elem tidelem;           /* List element for tid table. */
 
 	/* Shared between thread.c and synch.c. */
 	struct list_elem elem;              /* List element. */
@@ -103,8 +104,7 @@ struct thread
 	unsigned magic;                     /* Detects stack overflow. */
 
 	// Needed for file system sys calls
-	struct list opened_file_list;       /* Keeps track of files opened by a thread. */
-	int fd;                             /* File descriptor */
+	struct fd_table *fd_table;          /* Files opened by a thread, by fd. */
 
 	// Needed for wait / exec sys calls
 	struct list child_list;             /* Keeps track of child processes of a thread */
@@ -121,6 +121,14 @@ struct thread
 
 	/* For filesys dir */
 	struct dir *cur_working_dir;       /* Current working dir of thread. */
+
+	/* Scheduler statistics. */
+	int64_t run_ticks;                  /* Timer ticks spent running. */
+	unsigned vol_switches;              /* Switches away by blocking or yielding. */
+	unsigned invol_switches;            /* Switches away on time slice expiry. */
+	int64_t ready_since;                /* Cycle at which it last became ready. */
+	int64_t ready_cycles;               /* Total cycles spent on the run queue. */
+	bool woken;                         /* Made ready by thread_unblock()? */
 };
 
 enum load
@@ -151,6 +159,7 @@ void thread_start (void);
 
 void thread_tick (void);
 void thread_print_stats (void);
+void thread_print_sched_stats (void);
 
 typedef void thread_func (void *aux);
 tid_t thread_create (const char *name, int priority, thread_func *, void *);
@@ -184,6 +193,7 @@ void release_locks(void);
 
 void thread_sleep (const int64_t);
 void remove_from_blocked_list (int64_t);
+int64_t thread_next_wakeup (int64_t limit);
 bool compare_priority (const struct list_elem *a,
 		const struct list_elem *b,
 		void *aux UNUSED);
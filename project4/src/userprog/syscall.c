@@ -1,8 +1,13 @@
 #include "userprog/syscall.h"
+#include <bitmap.h>
+#include <limits.h>
+#include <round.h>
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
 #include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "devices/input.h"
@@ -14,12 +19,32 @@
 #include "userprog/pagedir.h"
 #include "userprog/process.h"
 
+/* Most buffers one readv or writev call may name.  Must
+   match IOV_MAX in lib/user/syscall.h. */
+#define IOV_MAX 32
+
+/* Pages in the kernel buffer that readv, writev, pread and
+   pwrite stage data in, so that one file system call covers
+   many user buffers and many sectors. */
+#define VECTOR_IO_PAGES 8
+
+/* One buffer of a readv or writev call, laid out like struct
+   iovec in lib/user/syscall.h.  IOV_BASE is a user address. */
+struct iovec
+{
+    void *iov_base;
+    size_t iov_len;
+};
+
 static void syscall_handler (struct intr_frame *);
 static void check_ptr_validity (const void *vaddr);
 static int map_user_to_kernel_vaddr (const void* vaddr);
 static void check_buffer_validity (void* buffer, unsigned size);
-static void extract_args (struct intr_frame *f, int numargs, int *args);
+static void check_user_block (const void *uaddr, size_t size);
 static void check_str_validity (const void *str);
+static void close_process_file (struct file_for_process *);
+static int vector_io (int fd, const struct iovec *iov, int iovcnt, off_t ofs,
+		bool is_read);
 
 void
 syscall_init (void)
@@ -46,25 +71,37 @@ check_ptr_validity (const void *vaddr)
 	}
 }
 
+/*
+ * Checks that every byte of the string str is
+ * mapped.  The page directory is walked once
+ * per page the string spans.
+ */
 static void
 check_str_validity (const void* str)
 {
-  while (* (char *) map_user_to_kernel_vaddr(str) != 0) {
-      str = (char *) str + 1;
+  const char *kstr = (const char *) map_user_to_kernel_vaddr (str);
+  while (*kstr != 0) {
+      str = (const char *) str + 1;
+      if (pg_ofs (str) == 0)
+        kstr = (const char *) map_user_to_kernel_vaddr (str);
+      else
+        kstr++;
     }
 }
 
 /*
  * Returns the kernel virtual address corresponding to
  * user virtual address. If not present, exits with a
- * -1 status.
+ * -1 status.  One page directory walk does both the
+ * check and the translation.
  */
 static int
 map_user_to_kernel_vaddr (const void *vaddr)
 {
-	check_ptr_validity (vaddr);
-	struct thread *cur = thread_current ();
-	void *kernel_vaddr = pagedir_get_page (cur->pagedir, vaddr);
+	void *kernel_vaddr = NULL;
+	if (vaddr != NULL && is_user_vaddr (vaddr)) {
+		kernel_vaddr = pagedir_get_page (thread_current ()->pagedir, vaddr);
+	}
 	if (!kernel_vaddr)
 	{
 		exit (-1);
@@ -72,156 +109,353 @@ map_user_to_kernel_vaddr (const void *vaddr)
 	return (int) kernel_vaddr;
 }
 
+/*
+ * Copies SIZE bytes from the kernel buffer KBUF to user
+ * address UBUF, or from UBUF into KBUF if TO_USER is false,
+ * translating UBUF one page at a time.  Exits with -1
+ * status if a page of UBUF is not mapped.
+ */
+static void
+copy_user (void *ubuf, void *kbuf, size_t size, bool to_user)
+{
+	uint8_t *u = ubuf;
+	uint8_t *k = kbuf;
+
+	while (size > 0) {
+		size_t chunk = PGSIZE - pg_ofs (u);
+		uint8_t *kaddr = (uint8_t *) map_user_to_kernel_vaddr (u);
+		if (chunk > size) {
+			chunk = size;
+		}
+		if (to_user) {
+			memcpy (kaddr, k, chunk);
+		} else {
+			memcpy (k, kaddr, chunk);
+		}
+		u += chunk;
+		k += chunk;
+		size -= chunk;
+	}
+}
+
 /*
  * Used for read/write syscalls to check memory
  * pointer validity of the buffer to read/write.
+ * Mappings are per page, so one check per page
+ * spanned by the buffer is enough.
  */
 static void
 check_buffer_validity (void* buffer, unsigned size)
 {
-	unsigned i;
-	char *temp_buffer = (char *) buffer;
-	for (i=0; i<size; i++) {
-		check_ptr_validity ((const void*) temp_buffer);
-		temp_buffer++;
+	const uint8_t *start = buffer;
+	const uint8_t *last = start + size - 1;
+	const uint8_t *upage;
+
+	if (size == 0) {
+		return;
+	}
+	if (last < start) {
+		exit (-1);
+	}
+
+	for (upage = pg_round_down (start);
+			upage <= (const uint8_t *) pg_round_down (last);
+			upage += PGSIZE) {
+		check_ptr_validity (upage < start ? start : upage);
 	}
 }
 
 /*
- * Extract numargs args from stack and save
- * them in *args.
+ * Checks that the SIZE bytes at user address UADDR, which
+ * may span at most two pages, are mapped.  Exits with -1
+ * status if not.
  */
 static void
-extract_args (struct intr_frame *f, int numargs, int *args)
+check_user_block (const void *uaddr, size_t size)
 {
-	int i;
-	int *ptr;
-	for (i=1; i<=numargs; i++)
-	{
-		ptr = ((int *) f->esp) + i;
-		check_ptr_validity(ptr);
-		args[i-1] = *ptr;
+	const uint8_t *start = uaddr;
+	const uint8_t *last = start + size - 1;
+	uint32_t *pd = thread_current ()->pagedir;
+
+	ASSERT (size > 0 && size <= PGSIZE);
+	if (start == NULL || last < start || !is_user_vaddr (last)
+			|| pagedir_get_page (pd, start) == NULL
+			|| (pg_no (last) != pg_no (start)
+					&& pagedir_get_page (pd, last) == NULL)) {
+		exit (-1);
+	}
+}
+
+/*
+ * Checks the string at user address STR and returns its
+ * kernel address.
+ */
+static const char *
+user_str (int str)
+{
+	check_str_validity ((const void *) str);
+	return (const char *) map_user_to_kernel_vaddr ((const void *) str);
+}
+
+/* System call wrappers.  Each takes the argument words
+   copied from the user stack, checks and translates any
+   pointers among them, and returns the value for eax. */
+
+static int
+sys_halt (const int *args UNUSED)
+{
+	halt ();
+	return 0;
+}
+
+static int
+sys_exit (const int *args)
+{
+	exit (args[0]);
+	return 0;
+}
+
+static int
+sys_exec (const int *args)
+{
+	return exec (user_str (args[0]));
+}
+
+static int
+sys_wait (const int *args)
+{
+	return wait ((pid_t) args[0]);
+}
+
+static int
+sys_create (const int *args)
+{
+	return create (user_str (args[0]), (unsigned) args[1]);
+}
+
+static int
+sys_remove (const int *args)
+{
+	return remove (user_str (args[0]));
+}
+
+static int
+sys_open (const int *args)
+{
+	return open (user_str (args[0]));
+}
+
+static int
+sys_filesize (const int *args)
+{
+	return filesize (args[0]);
+}
+
+static int
+sys_read (const int *args)
+{
+	check_buffer_validity ((void *) args[1], (unsigned) args[2]);
+	return read (args[0], (void *) map_user_to_kernel_vaddr ((const void *) args[1]),
+			(unsigned) args[2]);
+}
+
+static int
+sys_write (const int *args)
+{
+	check_buffer_validity ((void *) args[1], (unsigned) args[2]);
+	return write (args[0], (void *) map_user_to_kernel_vaddr ((const void *) args[1]),
+			(unsigned) args[2]);
+}
+
+static int
+sys_seek (const int *args)
+{
+	seek (args[0], (unsigned) args[1]);
+	return 0;
+}
+
+static int
+sys_tell (const int *args)
+{
+	return tell (args[0]);
+}
+
+static int
+sys_close (const int *args)
+{
+	close (args[0]);
+	return 0;
+}
+
+static int
+sys_chdir (const int *args)
+{
+	return chdir (user_str (args[0]));
+}
+
+static int
+sys_mkdir (const int *args)
+{
+	return mkdir (user_str (args[0]));
+}
+
+static int
+sys_readdir (const int *args)
+{
+	return readdir (args[0], (char *) user_str (args[1]));
+}
+
+static int
+sys_isdir (const int *args)
+{
+	return isdir (args[0]);
+}
+
+static int
+sys_inumber (const int *args)
+{
+	return inumber (args[0]);
+}
+
+static int
+sys_schedstat (const int *args UNUSED)
+{
+	thread_print_sched_stats ();
+	return 0;
+}
+
+/*
+ * Copies the IOVCNT iovecs at user address UIOV into IOV.
+ * Returns false if IOVCNT is out of range.
+ */
+static bool
+copy_in_iov (struct iovec *iov, const void *uiov, int iovcnt)
+{
+	size_t size = iovcnt * sizeof *iov;
+
+	if (iovcnt < 0 || iovcnt > IOV_MAX) {
+		return false;
+	}
+	copy_user ((void *) uiov, iov, size, false);
+	return true;
+}
+
+static int
+sys_readv (const int *args)
+{
+	struct iovec iov[IOV_MAX];
+
+	if (!copy_in_iov (iov, (const void *) args[1], args[2])) {
+		return -1;
+	}
+	return vector_io (args[0], iov, args[2], -1, true);
+}
+
+static int
+sys_writev (const int *args)
+{
+	struct iovec iov[IOV_MAX];
+
+	if (!copy_in_iov (iov, (const void *) args[1], args[2])) {
+		return -1;
 	}
+	return vector_io (args[0], iov, args[2], -1, false);
 }
 
+static int
+sys_pread (const int *args)
+{
+	struct iovec iov = {(void *) args[1], (unsigned) args[2]};
+
+	if (args[3] < 0) {
+		return -1;
+	}
+	return vector_io (args[0], &iov, 1, args[3], true);
+}
+
+static int
+sys_pwrite (const int *args)
+{
+	struct iovec iov = {(void *) args[1], (unsigned) args[2]};
+
+	if (args[3] < 0) {
+		return -1;
+	}
+	return vector_io (args[0], &iov, 1, args[3], false);
+}
+
+/* Most argument words any system call takes. */
+#define SYSCALL_MAX_ARGS 4
+
+/* A system call as seen by the dispatcher. */
+struct syscall_entry
+{
+	int arg_cnt;                        /* Argument words on the user stack. */
+	int (*func) (const int *args);      /* Wrapper that carries it out. */
+};
+
+/*
+ * Dispatch table, indexed by system call number.  Numbers
+ * without an entry kill the process.
+ */
+static const struct syscall_entry syscall_table[] =
+{
+	[SYS_HALT] = {0, sys_halt},
+	[SYS_EXIT] = {1, sys_exit},
+	[SYS_EXEC] = {1, sys_exec},
+	[SYS_WAIT] = {1, sys_wait},
+	[SYS_CREATE] = {2, sys_create},
+	[SYS_REMOVE] = {1, sys_remove},
+	[SYS_OPEN] = {1, sys_open},
+	[SYS_FILESIZE] = {1, sys_filesize},
+	[SYS_READ] = {3, sys_read},
+	[SYS_WRITE] = {3, sys_write},
+	[SYS_SEEK] = {2, sys_seek},
+	[SYS_TELL] = {1, sys_tell},
+	[SYS_CLOSE] = {1, sys_close},
+	[SYS_CHDIR] = {1, sys_chdir},
+	[SYS_MKDIR] = {1, sys_mkdir},
+	[SYS_READDIR] = {2, sys_readdir},
+	[SYS_ISDIR] = {1, sys_isdir},
+	[SYS_INUMBER] = {1, sys_inumber},
+	[SYS_SCHEDSTAT] = {0, sys_schedstat},
+	[SYS_READV] = {3, sys_readv},
+	[SYS_WRITEV] = {3, sys_writev},
+	[SYS_PREAD] = {4, sys_pread},
+	[SYS_PWRITE] = {4, sys_pwrite},
+};
+
+/*
+ * Validates the call number and its arguments on the user
+ * stack as one block, copies the arguments out, and calls
+ * the wrapper from syscall_table.  The number's page is
+ * looked up once; the next page is only looked up if the
+ * arguments run onto it.
+ */
 static void
-syscall_handler (struct intr_frame *f UNUSED)
-{
-    int args[3];
-    int esp = map_user_to_kernel_vaddr((const void *) f->esp);
-    switch (* (int *) esp) {
-
-    case SYS_HALT:
-        halt ();
-        break;
-
-    case SYS_EXIT:
-        extract_args (f, 1, &args[0]);
-        exit (args[0]);
-        break;
-
-    case SYS_EXEC:
-        extract_args (f, 1, &args[0]);
-        check_str_validity((const void *) args[0]);
-        args[0] = map_user_to_kernel_vaddr((const void*) args[0]);
-        f->eax = exec ((const char*) args[0]);
-        break;
-
-    case SYS_WAIT:
-        extract_args (f, 1, &args[0]);
-        f->eax = wait ((pid_t) args[0]);
-        break;
-
-    case SYS_CREATE:
-        extract_args (f, 2, &args[0]);
-        check_str_validity((const void *) args[0]);
-        args[0] = map_user_to_kernel_vaddr((const void*) args[0]);
-        f->eax = create ((const char*) args[0], (unsigned) args[1]);
-        break;
-
-    case SYS_REMOVE:
-        extract_args (f, 1, &args[0]);
-        check_str_validity((const void *) args[0]);
-        args[0] = map_user_to_kernel_vaddr((const void*) args[0]);
-        f->eax = remove ((const char*) args[0]);
-        break;
-
-    case SYS_OPEN:
-        extract_args (f, 1, &args[0]);
-        check_str_validity((const void *) args[0]);
-        args[0] = map_user_to_kernel_vaddr((const void*) args[0]);
-        f->eax = open ((const char*) args[0]);
-        break;
-
-    case SYS_FILESIZE:
-        extract_args (f, 1, &args[0]);
-        f->eax = filesize (args[0]);
-        break;
-
-    case SYS_READ:
-        extract_args (f, 3, &args[0]);
-        check_buffer_validity ((void *) args[1], (unsigned) args[2]);
-        args[1] = map_user_to_kernel_vaddr((const void*) args[1]);
-        f->eax = read ((int) args[0], (void *) args[1], (unsigned) args[2]);
-        break;
-
-    case SYS_WRITE:
-        extract_args (f, 3, &args[0]);
-        check_buffer_validity ((void *) args[1], (unsigned) args[2]);
-        args[1] = map_user_to_kernel_vaddr((const void*) args[1]);
-        f->eax = write ((int) args[0], (void *) args[1], (unsigned) args[2]);
-        break;
-
-    case SYS_SEEK:
-        extract_args (f, 2, &args[0]);
-        seek ((int) args[0], (unsigned) args[1]);
-        break;
-
-    case SYS_TELL:
-        extract_args (f, 1, &args[0]);
-        f->eax = tell ((int) args[0]);
-        break;
-
-    case SYS_CLOSE:
-        extract_args (f, 1, &args[0]);
-        close ((int) args[0]);
-        break;
-
-	case SYS_CHDIR:
-		extract_args (f, 1, &args[0]);
-		check_str_validity ((const void *) args[0]);
-		args[0] = map_user_to_kernel_vaddr ((const void *) args[0]);
-		f->eax = chdir ((const char *) args[0]);
-		break;
-
-	case SYS_MKDIR:
-		extract_args (f, 1, &args[0]);
-		check_str_validity ((const void *) args[0]);
-		args[0] = map_user_to_kernel_vaddr ((const void *) args[0]);
-		f->eax = mkdir ((const char *) args[0]);
-		break;
-
-	case SYS_READDIR:
-		extract_args (f, 2, &args[0]);
-		check_str_validity ((const void *) args[1]);
-		args[1] = map_user_to_kernel_vaddr ((const void *) args[1]);
-		f->eax = readdir (args[0], (char *) args[1]);
-		break;
-
-	case SYS_ISDIR:
-		extract_args (f, 1, &args[0]);
-		f->eax = isdir (args[0]);
-		break;
-
-	case SYS_INUMBER:
-		extract_args (f, 1, &args[0]);
-		f->eax = inumber (args[0]);
-		break;
-
-	default:
-        exit (-1);
-        break;
-    }
+syscall_handler (struct intr_frame *f)
+{
+	const int *esp = f->esp;
+	const struct syscall_entry *sc;
+	const uint8_t *last;
+	int args[SYSCALL_MAX_ARGS];
+	unsigned nr;
+
+	check_user_block (esp, sizeof *esp);
+	nr = *esp;
+	if (nr >= sizeof syscall_table / sizeof *syscall_table
+			|| syscall_table[nr].func == NULL) {
+		exit (-1);
+	}
+	sc = &syscall_table[nr];
+
+	last = (const uint8_t *) (esp + 1 + sc->arg_cnt) - 1;
+	if (pg_no (last) != pg_no ((const uint8_t *) (esp + 1) - 1)) {
+		check_user_block (last, 1);
+	}
+	memcpy (args, esp + 1, sc->arg_cnt * sizeof *esp);
+
+	f->eax = sc->func (args);
 }
 
 bool
@@ -236,21 +470,106 @@ mkdir (const char* dir)
 	return filesys_create (dir, 0, true);
 }
 
-bool
-readdir (int fd, char* name)
+/*
+ * Creates an empty fd table in a block of PAGE_CNT pages, with fds
+ * 0 and 1 reserved for the console.  Returns a null pointer if the
+ * pages cannot be allocated.
+ */
+static struct fd_table *
+fd_table_create (size_t page_cnt)
+{
+	size_t size = page_cnt * PGSIZE;
+	struct fd_table *t = palloc_get_multiple (PAL_ZERO, page_cnt);
+	size_t slot_cnt;
+
+	if (t == NULL) {
+		return NULL;
+	}
+
+	/* Fit as many slots as we can, leaving room for the bitmap. */
+	slot_cnt = (size - sizeof *t) / sizeof *t->slots;
+	while (sizeof *t + slot_cnt * sizeof *t->slots
+			+ bitmap_buf_size (slot_cnt) > size) {
+		slot_cnt--;
+	}
+
+	t->page_cnt = page_cnt;
+	t->slot_cnt = slot_cnt;
+	t->used = bitmap_create_in_buf (slot_cnt, t->slots + slot_cnt,
+			size - ((uint8_t *) (t->slots + slot_cnt) - (uint8_t *) t));
+	bitmap_set_multiple (t->used, 0, 2, true);
+	return t;
+}
+
+/*
+ * Returns the running process's slot for FD, or a null pointer if
+ * FD is not open.
+ */
+static struct file_for_process *
+lookup_fd (int fd)
+{
+	struct fd_table *t = thread_current ()->fd_table;
+
+	if (t == NULL || fd < 2 || (size_t) fd >= t->slot_cnt
+			|| !bitmap_test (t->used, fd)) {
+		return NULL;
+	}
+	return &t->slots[fd];
+}
+
+/*
+ * Gives PROCESS_FILE the lowest free fd of the running process and
+ * returns it, doubling the table if it is full.  Returns -1 if no
+ * memory is available.
+ */
+static int
+install_fd (const struct file_for_process *process_file)
 {
-	struct file_for_process *process_file = NULL;
 	struct thread *cur = thread_current ();
-	struct list_elem *e;
-	for (e = list_begin (&cur->opened_file_list);
-			e != list_end (&cur->opened_file_list);
-			e = list_next(e)) {
-		process_file = list_entry (e, struct file_for_process, file_elem);
-		if (fd == process_file->fd) {
-			break;
+	struct fd_table *t = cur->fd_table;
+	size_t fd;
+
+	if (t == NULL) {
+		t = cur->fd_table = fd_table_create (1);
+		if (t == NULL) {
+			return -1;
+		}
+	}
+
+	fd = bitmap_scan_and_flip (t->used, 0, 1, false);
+	if (fd == BITMAP_ERROR) {
+		struct fd_table *bigger = fd_table_create (t->page_cnt * 2);
+		if (bigger == NULL) {
+			return -1;
 		}
+		memcpy (bigger->slots, t->slots, t->slot_cnt * sizeof *t->slots);
+		bitmap_set_multiple (bigger->used, 0, t->slot_cnt, true);
+		palloc_free_multiple (t, t->page_cnt);
+		t = cur->fd_table = bigger;
+		fd = bitmap_scan_and_flip (t->used, 0, 1, false);
 	}
 
+	t->slots[fd] = *process_file;
+	return fd;
+}
+
+/*
+ * Frees FD of the running process for reuse.  FD must be open.
+ */
+static void
+release_fd (int fd)
+{
+	struct fd_table *t = thread_current ()->fd_table;
+
+	memset (&t->slots[fd], 0, sizeof t->slots[fd]);
+	bitmap_reset (t->used, fd);
+}
+
+bool
+readdir (int fd, char* name)
+{
+	struct file_for_process *process_file = lookup_fd (fd);
+
 	if (!process_file
 			|| !process_file->isdir
 			|| !dir_readdir(process_file->dir, name)) {
@@ -263,37 +582,14 @@ readdir (int fd, char* name)
 bool
 isdir (int fd)
 {
-	struct file_for_process *process_file = NULL;
-	struct thread *cur = thread_current();
-	struct list_elem *e;
-	for (e = list_begin(&cur->opened_file_list);
-			e != list_end(&cur->opened_file_list); e = list_next(e)) {
-		process_file = list_entry(e, struct file_for_process, file_elem);
-		if (fd == process_file->fd) {
-			break;
-		}
-	}
-	if (process_file) {
-		return process_file->isdir;
-	} else {
-		return -1;
-	}
+	struct file_for_process *process_file = lookup_fd (fd);
+	return process_file != NULL && process_file->isdir;
 }
 
 int
 inumber(int fd)
 {
-	struct file_for_process *process_file = NULL;
-	struct thread *cur = thread_current ();
-	struct list_elem *e;
-	for (e = list_begin (&cur->opened_file_list);
-			e != list_end (&cur->opened_file_list);
-			e = list_next (e)) {
-		process_file = list_entry (e, struct file_for_process, file_elem);
-		if (fd == process_file->fd) {
-			break;
-		}
-	}
+	struct file_for_process *process_file = lookup_fd (fd);
 	if (process_file == NULL) {
 		return -1;
 	}
@@ -396,24 +692,21 @@ open (const char *file)
 	if (file_to_open == NULL) {
 		is_open = -1;
 	} else {
+		struct file_for_process process_file;
 
-		struct thread *cur = thread_current ();
-		struct file_for_process *process_file =
-				malloc (sizeof *process_file);
-
-		if (!process_file) {
-			is_open = -1;
-		} else if (inode_isdir (file_get_inode (file_to_open))) {
-			process_file->isdir = true;
-			process_file->dir = (struct dir*) file_to_open;
+		if (inode_isdir (file_get_inode (file_to_open))) {
+			process_file.isdir = true;
+			process_file.dir = (struct dir*) file_to_open;
+			process_file.file = NULL;
 		} else {
-			process_file->isdir = false;
-			process_file->file = file_to_open;
+			process_file.isdir = false;
+			process_file.dir = NULL;
+			process_file.file = file_to_open;
+		}
+		is_open = install_fd (&process_file);
+		if (is_open == -1) {
+			close_process_file (&process_file);
 		}
-		process_file->fd = cur->fd;
-		is_open = cur->fd;
-		cur->fd++;
-		list_push_back (&cur->opened_file_list, &process_file->file_elem);
 	}
 
 	return is_open;
@@ -422,32 +715,11 @@ open (const char *file)
 int
 filesize (int fd)
 {
-	int filesize = -1;
-
-	struct thread *cur = thread_current ();
-	struct list_elem *e;
-	for (e = list_begin (&cur->opened_file_list);
-			e != list_end (&cur->opened_file_list);
-			e = list_next(e)) {
-		struct file_for_process *process_file =
-				list_entry (e, struct file_for_process, file_elem);
-		if (process_file == NULL) {
-			filesize = -1;
-			break;
-		}
-
-		if (fd == process_file->fd) {
-			if (process_file->isdir) {
-				filesize = -1;
-				break;
-			}
-
-			filesize = file_length (process_file->file);
-			break;
-		}
+	struct file_for_process *process_file = lookup_fd (fd);
+	if (process_file == NULL || process_file->isdir) {
+		return -1;
 	}
-
-	return filesize;
+	return file_length (process_file->file);
 }
 
 int
@@ -462,29 +734,16 @@ read (int fd, void *buffer, unsigned size)
 		}
 		return num_bytes_read;
 	}
-	lock_acquire (&file_lock);
-
-	struct thread *cur = thread_current ();
-	struct list_elem *e;
-	for (e = list_begin (&cur->opened_file_list);
-			e != list_end (&cur->opened_file_list);
-			e = list_next (e)) {
-		struct file_for_process *process_file =
-				list_entry (e, struct file_for_process, file_elem);
-		if (process_file == NULL) {
-			num_bytes_read = -1;
-			break;
-		}
-
-		if (fd == process_file->fd) {
-			if (process_file->isdir) {
-				num_bytes_read = -1;
-				break;
-			}
-			num_bytes_read = file_read (process_file->file, buffer, size);
-			break;
-		}
+	struct file_for_process *process_file = lookup_fd (fd);
+	if (process_file == NULL) {
+		return 0;
+	}
+	if (process_file->isdir) {
+		return -1;
 	}
+
+	lock_acquire (&file_lock);
+	num_bytes_read = file_read (process_file->file, buffer, size);
 	lock_release (&file_lock);
 	return num_bytes_read;
 }
@@ -496,87 +755,178 @@ write (int fd, const void *buffer, unsigned size)
 		putbuf ((const char *) buffer, (size_t) size);
 		return size;
 	}
-	lock_acquire (&file_lock);
 	int num_bytes_written = 0;
-	struct thread *cur = thread_current ();
-	struct list_elem *e;
-	for (e = list_begin (&cur->opened_file_list);
-			e != list_end (&cur->opened_file_list);
-			e = list_next(e)) {
-		struct file_for_process *process_file =
-				list_entry (e, struct file_for_process, file_elem);
-		if (process_file == NULL || process_file->file == NULL) {
-			num_bytes_written = -1;
-			break;
-		}
+	struct file_for_process *process_file = lookup_fd (fd);
+	if (process_file == NULL) {
+		return 0;
+	}
+	if (process_file->isdir) {
+		return -1;
+	}
 
-		if (fd == process_file->fd) {
-			if (process_file->isdir) {
-				num_bytes_written = -1;
-				break;
-			}
-			num_bytes_written =
-					file_write (process_file->file, buffer, size);
-			break;
+	lock_acquire (&file_lock);
+	num_bytes_written = file_write (process_file->file, buffer, size);
+	lock_release (&file_lock);
+	return num_bytes_written;
+}
+
+/*
+ * Reads or writes SIZE bytes between descriptor FD and the
+ * kernel buffer KBUF, at byte offset OFS or, if OFS is
+ * negative, at the file's current position.  Returns the
+ * number of bytes moved, or -1 if FD is not open or names
+ * the console along with an offset or a directory.
+ */
+static int
+transfer_at (int fd, void *kbuf, unsigned size, off_t ofs, bool is_read)
+{
+	struct file_for_process *process_file;
+	int moved;
+
+	if (fd == 0 || fd == 1) {
+		if (ofs >= 0 || is_read != (fd == 0)) {
+			return -1;
 		}
+		return is_read ? read (fd, kbuf, size) : write (fd, kbuf, size);
+	}
+	process_file = lookup_fd (fd);
+	if (process_file == NULL || process_file->isdir) {
+		return -1;
 	}
 
+	lock_acquire (&file_lock);
+	if (ofs < 0) {
+		moved = is_read ? file_read (process_file->file, kbuf, size)
+				: file_write (process_file->file, kbuf, size);
+	} else {
+		moved = is_read ? file_read_at (process_file->file, kbuf, size, ofs)
+				: file_write_at (process_file->file, kbuf, size, ofs);
+	}
 	lock_release (&file_lock);
-	return num_bytes_written;
+	return moved;
 }
 
-void
-seek (int fd, unsigned position)
+/*
+ * Copies SIZE bytes from the kernel buffer KBUF to the
+ * buffers in IOV, or from them into KBUF if TO_USER is
+ * false, starting *OFS bytes into *IOV.  Advances *IOV
+ * and *OFS past the bytes copied.
+ */
+static void
+copy_iov (const struct iovec **iov, size_t *ofs, uint8_t *kbuf, size_t size,
+		bool to_user)
 {
-	struct thread *cur = thread_current ();
-	struct list_elem *e;
-	for (e = list_begin (&cur->opened_file_list);
-			e != list_end (&cur->opened_file_list);
-			e = list_next(e)) {
-		struct file_for_process *process_file =
-				list_entry (e, struct file_for_process, file_elem);
-		if (process_file == NULL) {
-			break;
+	while (size > 0) {
+		size_t chunk = (*iov)->iov_len - *ofs;
+		if (chunk == 0) {
+			(*iov)++;
+			*ofs = 0;
+			continue;
 		}
-		if (fd == process_file->fd) {
-			if (process_file->isdir) {
-				break;
-			}
-			if (process_file->file != NULL) {
-				file_seek (process_file->file, position);
-			}
-			break;
+		if (chunk > size) {
+			chunk = size;
 		}
+		copy_user ((uint8_t *) (*iov)->iov_base + *ofs, kbuf, chunk, to_user);
+		*ofs += chunk;
+		kbuf += chunk;
+		size -= chunk;
 	}
 }
 
-unsigned
-tell (int fd)
+/*
+ * Carries out readv, writev, pread and pwrite: moves the
+ * bytes of the IOVCNT user buffers in IOV to or from FD, at
+ * offset OFS or, if OFS is negative, at the file's current
+ * position.  The buffers are gathered into, or scattered
+ * from, a kernel buffer of up to VECTOR_IO_PAGES pages, so
+ * each file system call covers many buffers and sectors.
+ * Returns the number of bytes moved, or -1 on error.
+ */
+static int
+vector_io (int fd, const struct iovec *iov, int iovcnt, off_t ofs,
+		bool is_read)
 {
-	unsigned nxt_byte_pos = -1;
-	struct thread *cur = thread_current ();
-	struct list_elem *e;
-	for (e = list_begin (&cur->opened_file_list);
-			e != list_end (&cur->opened_file_list);
-			e = list_next(e)) {
-		struct file_for_process *process_file =
-				list_entry (e, struct file_for_process, file_elem);
-		if (process_file == NULL) {
-			nxt_byte_pos = -1;
-			break;
+	const struct iovec *cur = iov;
+	size_t cur_ofs = 0;
+	size_t total = 0;
+	size_t done = 0;
+	size_t page_cnt;
+	uint8_t *kbuf;
+	int i;
+
+	// Check every buffer before staging anything, so that a
+	// bad one cannot kill the process with KBUF allocated.
+	for (i = 0; i < iovcnt; i++) {
+		if (iov[i].iov_len > (size_t) INT_MAX - total) {
+			return -1;
 		}
-		if (fd == process_file->fd) {
-			if (process_file->isdir) {
-				nxt_byte_pos = -1;
-			} else if (process_file->file == NULL) {
-				nxt_byte_pos = -1;
-			} else {
-				nxt_byte_pos = (file_tell (process_file->file));
-			}
+		check_buffer_validity (iov[i].iov_base, iov[i].iov_len);
+		total += iov[i].iov_len;
+	}
+	if (total == 0) {
+		return 0;
+	}
+
+	page_cnt = DIV_ROUND_UP (total, PGSIZE);
+	if (page_cnt > VECTOR_IO_PAGES) {
+		page_cnt = VECTOR_IO_PAGES;
+	}
+	kbuf = palloc_get_multiple (0, page_cnt);
+	if (kbuf == NULL) {
+		page_cnt = 1;
+		kbuf = palloc_get_page (0);
+		if (kbuf == NULL) {
+			return -1;
+		}
+	}
+
+	while (done < total) {
+		size_t chunk = total - done;
+		int moved;
+
+		if (chunk > page_cnt * PGSIZE) {
+			chunk = page_cnt * PGSIZE;
+		}
+		if (!is_read) {
+			copy_iov (&cur, &cur_ofs, kbuf, chunk, false);
+		}
+		moved = transfer_at (fd, kbuf, chunk, ofs, is_read);
+		if (moved < 0) {
+			palloc_free_multiple (kbuf, page_cnt);
+			return done > 0 ? (int) done : -1;
+		}
+		if (is_read) {
+			copy_iov (&cur, &cur_ofs, kbuf, moved, true);
+		}
+		done += moved;
+		if (ofs >= 0) {
+			ofs += moved;
+		}
+		if ((size_t) moved < chunk) {
 			break;
 		}
 	}
-	return nxt_byte_pos;
+	palloc_free_multiple (kbuf, page_cnt);
+	return done;
+}
+
+void
+seek (int fd, unsigned position)
+{
+	struct file_for_process *process_file = lookup_fd (fd);
+	if (process_file != NULL && !process_file->isdir) {
+		file_seek (process_file->file, position);
+	}
+}
+
+unsigned
+tell (int fd)
+{
+	struct file_for_process *process_file = lookup_fd (fd);
+	if (process_file == NULL || process_file->isdir) {
+		return -1;
+	}
+	return file_tell (process_file->file);
 }
 
 void
@@ -585,39 +935,41 @@ close (int fd)
 	close_file (fd);
 }
 
+/*
+ * Closes the file or directory in PROCESS_FILE.
+ */
+static void
+close_process_file (struct file_for_process *process_file)
+{
+	if (process_file->isdir) {
+		dir_close (process_file->dir);
+	} else {
+		file_close (process_file->file);
+	}
+}
+
 void
 close_file (int fd)
 {
 	struct thread *cur = thread_current ();
-	struct list_elem *e, *next;
-	for (e = list_begin (&cur->opened_file_list);
-			e != list_end (&cur->opened_file_list);) {
-		next = list_next (e);
-		struct file_for_process *process_file =
-				list_entry (e, struct file_for_process, file_elem);
-		if (process_file == NULL) {
-			break;
-		}
-
-		// -1 stands for closing all file descriptors.
-		if (fd == -1) {
-			if (process_file->isdir) {
-				dir_close (process_file->dir);
-			} else {
-				file_close (process_file->file);
+	struct fd_table *t = cur->fd_table;
+
+	// -1 stands for closing all file descriptors.
+	if (fd == -1) {
+		if (t != NULL) {
+			size_t i;
+			for (i = bitmap_scan (t->used, 2, 1, true); i != BITMAP_ERROR;
+					i = bitmap_scan (t->used, i + 1, 1, true)) {
+				close_process_file (&t->slots[i]);
 			}
-			list_remove (e);
-			free (process_file);
-		} else if (fd == process_file->fd) {
-			if (process_file->isdir) {
-				dir_close (process_file->dir);
-			} else {
-				file_close (process_file->file);
-			}
-			list_remove (e);
-			free (process_file);
-			break;
+			palloc_free_multiple (t, t->page_cnt);
+			cur->fd_table = NULL;
+		}
+	} else {
+		struct file_for_process *process_file = lookup_fd (fd);
+		if (process_file != NULL) {
+			close_process_file (process_file);
+			release_fd (fd);
 		}
-		e = next;
 	}
 }